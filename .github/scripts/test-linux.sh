@@ -27,8 +27,17 @@ ${PYBIN}/pip install ./dist/pyvirtualcam*cp${PYVER}*manylinux*.whl
 
 ${PYBIN}/pip install -r dev-requirements.txt
 
+# Install test helper package
+pushd test/image-formats
+${PYBIN}/pip install pybind11 setuptools
+${PYBIN}/pip install .
+popd
+
 mkdir tmp_for_test
 pushd tmp_for_test
+# The image format kernels do not need a virtual camera device.
+${PYBIN}/pytest -v -s /io/test/test_image_formats.py
+
 # NOTE: TESTING DISABLED!
 # The v4l2loopback kernel module cannot be installed as it depends
 # on v4l2 (videodev) kernel support.
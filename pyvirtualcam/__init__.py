@@ -1,3 +1,3 @@
 from ._version import __version__
 
-from .camera import Camera, PixelFormat, Backend, register_backend
+from .camera import Camera, MultiCamera, MosaicCamera, Output, Tile, PixelFormat, Backend, Device, register_backend, list_devices
@@ -1,6 +1,7 @@
-from typing import Optional, Dict, Type
+from typing import Optional, Dict, List, NamedTuple, Sequence, Tuple, Type, Union
 from abc import ABC, abstractmethod
 import platform
+import threading
 import time
 import warnings
 from enum import Enum
@@ -47,6 +48,14 @@ class Backend(ABC):
             If no device name is given (``None``) and no device is available
             then an exception must be raised.
         :param kw: Extra keyword arguments passed through from user code.
+            Includes ``input_size``, a ``(width, height)`` tuple, if the frames
+            passed to :meth:`send` are of another size than the camera
+            and the backend is expected to scale them.
+            A backend that cannot scale frames must raise an exception.
+            Likewise, includes ``mirror=True`` and ``rotate``, in degrees clockwise,
+            if frames are to be mirrored or rotated after scaling them,
+            in which case frames are of the rotated size, for example
+            ``(height, width)`` for 90 degrees, unless ``input_size`` is given.
         """
     
     @abstractmethod
@@ -61,10 +70,136 @@ class Backend(ABC):
     def send(self, frame: np.ndarray):
         """ Send the given frame to the camera device.
 
-        :param frame: A 1D C-contiguous uint8 numpy array corresponding
+        :param frame: A uint8 numpy array corresponding
             to the chosen pixel format and frame width and height.
+            For pixel formats with a ``(h, w[, c])`` shape, the array has that shape
+            and its rows may be padded, that is, it is not necessarily C-contiguous,
+            but the pixels within a row are. Otherwise, it is a 1D C-contiguous array.
+
+        If :meth:`Camera.send` is given a ``pts``, it is passed on as keyword argument
+        ``pts``, and likewise to :meth:`send_planes`. Backends without a jitter buffer
+        need not support this.
         """
     
+    def send_planes(self, planes: List[np.ndarray]):
+        """ Send the given frame, given as one array per plane, to the camera device.
+
+        This method is optional. By default, the planes are
+        packed into a single array and passed to :meth:`send`.
+
+        :param planes: One uint8 numpy array per plane of the chosen pixel format.
+            Each array is either 1D C-contiguous or has one row per row of the plane,
+            where rows may be padded but the bytes within a row are contiguous.
+        """
+        self.send(np.concatenate([plane.reshape(-1) for plane in planes]))
+
+    def send_many(self, frames: np.ndarray, timestamps: Optional[np.ndarray], pace: bool) -> Tuple[int, int]:
+        """ Send a batch of frames, see :meth:`Camera.send_many`.
+
+        This method is optional. By default, :meth:`Camera.send_many`
+        passes the frames to :meth:`send` one by one.
+
+        :param frames: A uint8 numpy array of frames stacked along the first axis,
+            each as passed to :meth:`send`. 1D frames are stacked into a 2D array.
+        :param timestamps: ``None`` or a float64 numpy array with one timestamp per frame.
+        :param pace: Whether to send frames at their timestamps.
+        :return: The number of frames sent and dropped.
+        """
+        raise NotImplementedError
+
+    def conversion_path(self) -> Optional[List[str]]:
+        """ Names of the conversion kernels that frames pass through
+        on their way to the native pixel format, empty if frames are not converted,
+        or ``None`` if not known.
+
+        This method is optional.
+        """
+        return None
+
+    def conversion_cost(self) -> Optional[float]:
+        """ Estimated cost of converting a frame, in nanoseconds per pixel,
+        or ``None`` if not known.
+
+        This method is optional.
+        """
+        return None
+
+    @staticmethod
+    def list_devices() -> List[Tuple[str, str, int, int, int]]:
+        """ The devices of this backend, as ``(device, name, fourcc, width, height)``
+        tuples, where ``device`` is a valid ``device`` constructor argument,
+        ``name`` is a human-readable label, and the rest describes the format
+        the device currently has, or is 0 if not known.
+
+        This method is optional.
+        """
+        return []
+
+    def sleep_until_next_frame(self) -> Optional[bool]:
+        """ Sleep until the next frame is due according to ``fps``.
+
+        This method is optional. If it returns ``False``, as by default,
+        :meth:`Camera.sleep_until_next_frame` sleeps in Python instead.
+        """
+        return False
+
+    def pacing_jitter(self) -> Optional[Tuple[float, float]]:
+        """ Mean and maximum time in milliseconds by which :meth:`sleep_until_next_frame`
+        returned after the next frame was due, or ``None`` if not known.
+
+        This method is optional.
+        """
+        return None
+
+    def hold_frame(self) -> bool:
+        """ Keep showing the last sent frame until the next one is sent,
+        without it being sent again.
+
+        This method is optional. By default, it returns ``False``,
+        meaning that the backend cannot hold frames.
+        """
+        return False
+
+    def has_consumers(self) -> Optional[bool]:
+        """ Whether an application is reading from the device,
+        or ``None`` if not known.
+
+        This method is optional.
+        """
+        return None
+
+    def queued_frames(self) -> Optional[int]:
+        """ Number of sent frames waiting to be passed on to the device,
+        or ``None`` if frames are not queued.
+
+        This method is optional.
+        """
+        return None
+
+    def arrival_jitter(self) -> Optional[float]:
+        """ Estimated arrival jitter in milliseconds of frames sent with a ``pts``,
+        or ``None`` if there is no jitter buffer.
+
+        This method is optional.
+        """
+        return None
+
+    def playout_delay(self) -> Optional[float]:
+        """ Time in milliseconds by which frames sent with a ``pts`` are held,
+        or ``None`` if there is no jitter buffer.
+
+        This method is optional.
+        """
+        return None
+
+    def dropped_frames(self) -> Optional[int]:
+        """ Number of sent frames dropped as the queue was full,
+        or ``None`` if frames are not queued.
+
+        This method is optional.
+        """
+        return None
+
     @abstractmethod
     def device(self) -> str:
         """ The name of the virtual camera device in use.
@@ -120,6 +255,23 @@ elif platform.system() == 'Linux':
     from pyvirtualcam import _native_linux_v4l2loopback
     register_backend('v4l2loopback', _native_linux_v4l2loopback.Camera)
 
+# Backends of MultiCamera. They take an extra ``outputs`` argument, a list of
+# ``(width, height, fourcc, device)`` tuples, and ``device`` is always ``None``.
+# Their ``device()`` is that of the first output, and ``devices()`` returns all of them.
+MULTI_BACKENDS: Dict[str, type] = {}
+
+if platform.system() == 'Linux':
+    MULTI_BACKENDS['v4l2loopback'] = _native_linux_v4l2loopback.MultiCamera
+
+# Backends of MosaicCamera. They take an extra ``tiles`` argument, a list of
+# ``(x, y, width, height, fourcc, device)`` tuples, where ``fourcc`` is 0 if the backend
+# is to choose, and ``device`` is always ``None``. Like for MULTI_BACKENDS, ``device()``
+# is that of the first tile, and ``devices()`` and ``native_fourccs()`` return those of all tiles.
+MOSAIC_BACKENDS: Dict[str, type] = {}
+
+if platform.system() == 'Linux':
+    MOSAIC_BACKENDS['v4l2loopback'] = _native_linux_v4l2loopback.MosaicCamera
+
 class PixelFormat(Enum):
     """ Pixel formats.
 
@@ -146,6 +298,9 @@ class PixelFormat(Enum):
     NV12 = 'NV12'
     """ Shape: any of size ``w * h * 3/2`` """
 
+    I422 = 'I422'
+    """ Shape: any of size ``w * h * 2`` """
+
     YUYV = 'YUY2'
     """ Shape: any of size ``w * h * 2`` """
 
@@ -165,16 +320,77 @@ FrameShapes = {
     PixelFormat.GRAY: lambda w, h: (h, w),
     PixelFormat.I420: lambda w, h: w * h * 3 // 2,
     PixelFormat.NV12: lambda w, h: w * h * 3 // 2,
+    PixelFormat.I422: lambda w, h: w * h * 2,
     PixelFormat.YUYV: lambda w, h: w * h * 2,
     PixelFormat.UYVY: lambda w, h: w * h * 2,
 }
 
+# (rows, bytes per row) of each plane, for frames sent as separate planes.
+PlaneShapes = {
+    PixelFormat.I420: lambda w, h: [(h, w), (h // 2, w // 2), (h // 2, w // 2)],
+    PixelFormat.NV12: lambda w, h: [(h, w), (h // 2, w)],
+    PixelFormat.I422: lambda w, h: [(h, w), (h, w // 2), (h, w // 2)],
+}
+
+class Device(NamedTuple):
+    """ A virtual camera device, as returned by :func:`~pyvirtualcam.list_devices`.
+    """
+
+    device: str
+    """ Name of the device, as used for the ``device`` argument of :class:`~pyvirtualcam.Camera`. """
+
+    name: str
+    """ Human-readable label of the device. """
+
+    backend: str
+    """ Name of the backend the device belongs to. """
+
+    fmt: Optional[PixelFormat]
+    """ Current pixel format of the device, or ``None`` if not set or not known. """
+
+    width: Optional[int]
+    """ Current frame width, or ``None`` if not known. """
+
+    height: Optional[int]
+    """ Current frame height, or ``None`` if not known. """
+
+def list_devices(backend: Optional[str]=None) -> List[Device]:
+    """
+    List the devices of a backend, or of all backends if ``backend`` is ``None``.
+
+    Only the ``v4l2loopback`` backend lists its devices. It reads them from sysfs
+    without opening any of them, and includes devices that are in use.
+    
+    :param backend: Name of the backend.
+    """
+    names = [backend] if backend else list(BACKENDS)
+    devices = []
+    for name in names:
+        list_backend_devices = getattr(BACKENDS[name], 'list_devices', None)
+        if list_backend_devices is None:
+            continue
+        for device, label, fourcc, width, height in list_backend_devices():
+            fmt = PixelFormat(decode_fourcc(fourcc)) if fourcc else None
+            devices.append(Device(device, label, name, fmt, width or None, height or None))
+    return devices
+
 class Camera:
     """
     :param width: Frame width in pixels.
     :param height: Frame height in pixels.
     :param fps: Target frame rate in frames per second.
     :param fmt: Input pixel format.
+    :param input_size: Width and height of the frames passed to :meth:`send`
+        if they differ from ``width`` and ``height``. The backend scales them
+        natively to the size of the camera, before converting them to its native
+        format, see the ``fit`` and ``filter`` backend arguments.
+        By default, the size of the camera, or its height and width if ``rotate``
+        is 90 or 270 degrees.
+    :param mirror: Mirror frames horizontally, like a selfie view.
+    :param rotate: Rotate frames clockwise by 0, 90, 180 or 270 degrees, after mirroring them.
+        The backend mirrors and rotates frames natively, in one pass or none:
+        mirroring combined with a rotation by 180 degrees flips frames vertically,
+        which costs nothing. Frames in YUYV and UYVY format cannot be mirrored or rotated.
     :param device: The virtual camera device to use.
         If ``None``, the first available device is used.
 
@@ -193,20 +409,86 @@ class Camera:
         - ``unitycapture`` (Windows)
     :param print_fps: Print frame rate every second.
     :param kw: Extra keyword arguments forwarded to the backend.
-        Should only be given if a backend is specified.
-        Note that the built-in backends do not have extra arguments.
+        Arguments not supported by all backends should only be given
+        if a backend is specified.
+
+        All built-in backends support:
+
+        - ``threads`` (default 1): Number of threads used for pixel format
+          conversion. Each frame is split into horizontal bands that are
+          converted in parallel. The output is the same for any number of threads.
+        - ``cpu_affinity`` (default ``[]``): CPUs to pin the conversion
+          threads to, assigned round-robin. The calling thread is not pinned.
+          Not supported on macOS, where it is ignored.
+        - ``queue_depth`` (default 0): If not 0, :meth:`send` copies the frame into
+          a queue of this many frames and returns, while a separate thread
+          converts and sends them to the device.
+        - ``drop_policy`` (default ``'drop_oldest'``): What :meth:`send` does
+          if the queue is full: ``'drop_oldest'`` replaces the oldest queued frame,
+          ``'drop_newest'`` drops the frame being sent,
+          and ``'block'`` waits until a frame has been sent.
+        - ``jitter_buffer`` (default 0): If not 0, frames sent with a ``pts``
+          are held in a buffer of up to this many frames (at least 2) and sent
+          in PTS order by a separate thread when they are due, see :meth:`send`.
+          Cannot be combined with ``queue_depth``.
+        - ``fit`` (default ``'stretch'``): How frames of another ``input_size``
+          are fit into the camera: ``'stretch'`` scales them to the size of the camera,
+          ``'letterbox'`` keeps their aspect ratio and adds black bars,
+          and ``'crop'`` keeps their aspect ratio and cuts off the sides
+          or the top and bottom. Frames in YUYV and UYVY format cannot be scaled.
+        - ``filter`` (default ``'box'``): The filter used for scaling:
+          ``'point'`` (nearest neighbor), ``'bilinear'`` or ``'box'``,
+          which averages all input pixels when scaling down.
+
+        The ``v4l2loopback`` backend also supports:
+
+        - ``buffers`` (default 0): If not 0, the number of buffers shared with the device.
+          Frames are converted straight into these buffers instead of being
+          written to the device. If 0, or if the device does not support this,
+          frames are written.
+        - ``passthrough`` (default ``False``): Configure the device with the RGB, BGR
+          or RGBA input format instead of converting frames to I420.
+          RGBA input requires this. Not all consumers support these formats.
+          If the device does not support RGB or BGR, frames are converted as before,
+          see :attr:`native_fmt`.
+        - ``sustain_framerate`` (default ``False``): Let v4l2loopback repeat the last frame
+          if frames are sent slower than ``fps``, so that consumers still get ``fps`` frames.
+        - ``timeout`` (default 0): If not 0, show the timeout image once no frame
+          was sent for this many milliseconds.
+        - ``timeout_image`` (default ``None``): The image shown after the timeout,
+          as a frame in the chosen pixel format. If ``None``, a blank image is shown.
     """
+
+    # Backends to choose from, by name.
+    _registry: Dict[str, type] = BACKENDS
+
     def __init__(self, width: int, height: int, fps: float, *,
                  fmt: PixelFormat=PixelFormat.RGB,
+                 input_size: Optional[Tuple[int, int]]=None,
+                 mirror: bool=False,
+                 rotate: int=0,
                  device: Optional[str]=None,
                  backend: Optional[str]=None,
                  print_fps: bool=False,
                  **kw) -> None:
+        if input_size is not None:
+            input_size = (int(input_size[0]), int(input_size[1]))
+            kw['input_size'] = input_size
+        elif rotate in (90, 270):
+            input_size = (height, width)
+        else:
+            input_size = (width, height)
+        if mirror:
+            kw['mirror'] = True
+        if rotate:
+            kw['rotate'] = rotate
         if backend:
-            backends = [(backend, BACKENDS[backend])]
+            backends = [(backend, self._registry[backend])]
         else:
-            backends = list(BACKENDS.items())
+            backends = list(self._registry.items())
         self._backend = None
+        if not backends:
+            raise RuntimeError(f'{type(self).__name__} is not supported on this platform.')
         errors = []
         for name, clazz in backends:
             try:
@@ -227,9 +509,11 @@ class Camera:
         self._height = height
         self._fps = fps
         self._fmt = fmt
+        self._input_size = input_size
         self._print_fps = print_fps
 
-        frame_shape = FrameShapes[fmt](width, height)
+        frame_shape = FrameShapes[fmt](*input_size)
+        self._is_packed_shape = not isinstance(frame_shape, int)
         if isinstance(frame_shape, int):
             def check_frame_shape(frame: np.ndarray):
                 if frame.size != frame_shape:
@@ -246,6 +530,8 @@ class Camera:
         self._frames_sent = 0
         self._last_frame_t = None
         self._extra_time_per_frame = 0
+        # Guards the counters above, as frames may be sent from several threads.
+        self._stats_lock = threading.Lock()
 
     def __enter__(self):
         return self
@@ -281,6 +567,13 @@ class Camera:
         """
         return self._height
 
+    @property
+    def input_size(self) -> Tuple[int, int]:
+        """ Width and height of the frames passed to :meth:`send`,
+        the size of the camera unless ``input_size`` or ``rotate`` was given.
+        """
+        return self._input_size
+
     @property
     def fps(self) -> float:
         """ Target frame rate in frames per second.
@@ -307,6 +600,115 @@ class Camera:
         fourcc = self._backend.native_fourcc()
         return PixelFormat(decode_fourcc(fourcc)) if fourcc else None
 
+    @property
+    def conversion_path(self) -> Optional[List[str]]:
+        """ Names of the conversion steps from :attr:`fmt` to :attr:`native_fmt`,
+        chosen as the cheapest path through the available conversion kernels.
+        Empty if frames are passed on without conversion, or ``None``
+        if not known, for example for custom backends.
+        """
+        path = getattr(self._backend, 'conversion_path', lambda: None)()
+        return None if path is None else list(path)
+
+    @property
+    def conversion_cost(self) -> Optional[float]:
+        """ Estimated time in milliseconds to convert a frame on a single thread,
+        or ``None`` if not known, for example for custom backends.
+
+        The estimate is based on measurements on a typical machine
+        and is mostly useful to compare pixel formats.
+        """
+        cost = getattr(self._backend, 'conversion_cost', lambda: None)()
+        return None if cost is None else cost * self._width * self._height / 1e6
+
+    def hold_frame(self, frame: Optional[Union[np.ndarray, Sequence[np.ndarray]]]=None) -> bool:
+        """ Keep showing the last sent frame, or ``frame`` after sending it,
+        until the next call to :meth:`send`.
+
+        Call this once the content stops changing. Consumers like browsers
+        may freeze or time out if no frames arrive, so without this a static frame
+        would have to be sent again at the frame rate.
+        The ``v4l2loopback`` backend lets the driver repeat the frame at ``fps``
+        and suspends the ``timeout`` until the next frame is sent.
+        Frames still queued with ``queue_depth`` or ``jitter_buffer``
+        are passed on to the device first, so this may wait until they are due.
+
+        :param frame: Frame to send before holding it, see :meth:`send`.
+        :return: ``True`` if the backend keeps showing the frame by itself,
+            ``False`` if it must still be sent repeatedly to keep consumers going.
+        """
+        if frame is not None:
+            self.send(frame)
+        return getattr(self._backend, 'hold_frame', lambda: False)()
+
+    def set_overlay(self, image: Optional[np.ndarray], x: int=0, y: int=0) -> None:
+        """ Blend an image, like a logo or a badge, into every frame sent from now on.
+
+        The built-in backends convert the image to their native format once
+        and blend it into each frame after converting it, so that per frame only
+        the pixels the image covers are touched.
+        In YUV formats with subsampled chroma, the image is placed at an even
+        position and its chroma is blended at the resolution of the format.
+
+        :param image: A uint8 RGBA array of shape ``(h, w, 4)``, with straight
+            (not premultiplied) alpha, or ``None`` to remove the overlay.
+        :param x: Horizontal position of the left edge of the image in the frame.
+        :param y: Vertical position of the top edge of the image in the frame.
+            The image may extend beyond the frame, in which case it is cut off.
+        """
+        if image is not None:
+            if image.dtype != np.uint8:
+                raise TypeError(f'unexpected overlay dtype: {image.dtype} != uint8')
+            if image.ndim != 3 or image.shape[2] != 4:
+                raise ValueError(f'unexpected overlay shape: {image.shape}, expected (h, w, 4)')
+            if not image[0].flags.c_contiguous:
+                image = np.ascontiguousarray(image)
+        set_overlay = getattr(self._backend, 'set_overlay', None)
+        if set_overlay is None:
+            raise RuntimeError(f"'{self._backend_name}' backend does not support overlays")
+        set_overlay(image, int(x), int(y))
+
+    @property
+    def has_consumers(self) -> Optional[bool]:
+        """ Whether an application is reading from the virtual camera,
+        or ``None`` if the backend cannot tell.
+
+        While nobody is reading, :meth:`send` does not convert or send frames,
+        so rendering them could be skipped or slowed down, too.
+        Supported by ``v4l2loopback`` (v4l2loopback 0.13 or later)
+        and ``unitycapture``.
+        """
+        return getattr(self._backend, 'has_consumers', lambda: None)()
+
+    @property
+    def queued_frames(self) -> Optional[int]:
+        """ Number of frames waiting to be sent to the device, see the ``queue_depth``
+        backend argument, or ``None`` if not known, for example for custom backends.
+        """
+        return getattr(self._backend, 'queued_frames', lambda: None)()
+
+    @property
+    def dropped_frames(self) -> Optional[int]:
+        """ Number of frames dropped according to the ``drop_policy`` backend argument
+        or by the jitter buffer, or ``None`` if not known, for example for custom backends.
+        """
+        return getattr(self._backend, 'dropped_frames', lambda: None)()
+
+    @property
+    def arrival_jitter(self) -> Optional[float]:
+        """ Estimated jitter in milliseconds of the arrival of frames sent with a ``pts``,
+        or ``None`` if there is no jitter buffer, see the ``jitter_buffer`` backend argument.
+        """
+        return getattr(self._backend, 'arrival_jitter', lambda: None)()
+
+    @property
+    def playout_delay(self) -> Optional[float]:
+        """ Time in milliseconds by which the jitter buffer holds frames,
+        on top of the delay of the earliest frame to arrive so far, adapted to
+        :attr:`arrival_jitter`, or ``None`` if there is no jitter buffer.
+        """
+        return getattr(self._backend, 'playout_delay', lambda: None)()
+
     @property
     def frames_sent(self) -> int:
         """ Number of frames sent.
@@ -323,36 +725,249 @@ class Camera:
             self._backend.close()
             self._backend = None
 
-    def send(self, frame: np.ndarray) -> None:
+    def send(self, frame: Union[np.ndarray, Sequence[np.ndarray]], pts: Optional[float]=None) -> None:
         """Send a frame to the virtual camera device.
 
+        This method may be called from several threads at once.
+        The built-in backends convert and send frames without holding the GIL,
+        so that threads sending to different cameras run in parallel.
+
         :param frame: Frame to send. The shape of the array must match
-            the chosen :class:`~pyvirtualcam.PixelFormat`.
+            the chosen :class:`~pyvirtualcam.PixelFormat` and :attr:`input_size`.
+            Views of a larger image, for example a cropped region or
+            an OpenCV image with padded rows, are sent without copying them first.
+
+            Frames in I420, NV12 and I422 format can also be sent as a sequence
+            of one array per plane, for example ``(y, u, v)`` or ``(y, uv)``
+            as returned by video decoders, without packing them into one array first.
+            Each plane array has one row per row of the plane, for example
+            ``(h/2, w/2)`` for the U plane of I420 and ``(h/2, w)`` or ``(h/2, w/2, 2)``
+            for the UV plane of NV12. Rows may be padded. 1D arrays of the
+            plane size are accepted as well.
+        :param pts: Presentation timestamp of the frame in seconds, relative to any origin.
+            Requires the ``jitter_buffer`` backend argument. The frame is copied into
+            the jitter buffer and sent once it is due, in PTS order, on the schedule
+            given by the timestamps. Frames are held just long enough to absorb the
+            measured jitter of their arrival, see :attr:`arrival_jitter` and
+            :attr:`playout_delay`. Frames arriving after a frame with a later PTS
+            was sent are dropped and counted in :attr:`dropped_frames`.
+            The ``v4l2loopback`` backend passes the time each frame is due
+            on to consumers as buffer timestamp, as does ``obs`` on Windows.
+        """
+        if isinstance(frame, (tuple, list)):
+            planes = self._prepare_planes(frame, self._fmt, self._input_size)
+        else:
+            frame = self._prepare_frame(frame)
+
+        self._count_frame()
+        
+        kw = {} if pts is None else {'pts': pts}
+        if isinstance(frame, (tuple, list)):
+            if hasattr(self._backend, 'send_planes'):
+                self._backend.send_planes(planes, **kw)
+            else:
+                self._backend.send(np.concatenate([plane.reshape(-1) for plane in planes]), **kw)
+        else:
+            self._backend.send(frame, **kw)
+
+    def compose(self, layers: Sequence[Tuple[Optional[Union[np.ndarray, Sequence[np.ndarray]]],
+                                             PixelFormat, Tuple[int, int, int, int]]],
+                pts: Optional[float]=None) -> None:
+        """Compose a frame of several sources, like a picture-in-picture layout, and send it.
+
+        Each source is scaled and converted straight into its region of the frame,
+        without an intermediate full-size frame in Python. The built-in backends
+        draw the sources in parallel without holding the GIL and keep the frame
+        between calls, so that sources that did not change need not be drawn again.
+        Composed frames are sent as they are, regardless of ``input_size``,
+        ``mirror`` and ``rotate``, and the overlay, if any, is blended into them.
+
+        Sources are converted to the pixel format of the camera, so choosing the
+        native format of the backend, see :attr:`native_fmt`, saves converting
+        the composed frame again. A ``RuntimeError`` is raised for sources that
+        cannot be converted to it, like I420 sources for an RGB camera.
+        Sources are scaled with a box filter. Sources in YUYV or UYVY format
+        can only be scaled if the camera format can.
+
+        :param layers: ``(source, fmt, (x, y, width, height))`` tuples, drawn in order,
+            so that later layers cover earlier ones. ``source`` is a frame in the
+            :class:`~pyvirtualcam.PixelFormat` ``fmt`` of any size: an array of shape
+            ``(h, w[, c])``, or ``(h, w, 2)`` for YUYV and UYVY, or for I420, NV12
+            and I422 a sequence of one array per plane as for :meth:`send`.
+            If ``source`` is ``None``, the layer keeps its previous content,
+            which requires the layers to be the same as in the previous call.
+            The region must lie within the frame and, in formats with subsampled
+            chroma, have an even position and size.
+        :param pts: Presentation timestamp of the frame, see :meth:`send`.
         """
+        compose = getattr(self._backend, 'compose', None)
+        if compose is None:
+            raise RuntimeError(f"'{self._backend_name}' backend does not support composing frames")
+        prepared = []
+        for i, (source, fmt, rect) in enumerate(layers):
+            x, y, width, height = (int(v) for v in rect)
+            fourcc = encode_fourcc(fmt.value)
+            if source is None:
+                prepared.append((None, fourcc, 0, 0, x, y, width, height))
+                continue
+            if isinstance(source, (tuple, list)):
+                if len(source) == 0 or source[0].ndim < 2:
+                    raise ValueError(f'layer {i}: the first plane must be of shape (h, w)')
+                size = (source[0].shape[1], source[0].shape[0])
+                arrays = self._prepare_planes(source, fmt, size)
+            else:
+                if source.dtype != np.uint8:
+                    raise TypeError(f'layer {i}: unexpected dtype: {source.dtype} != uint8')
+                if fmt in PlaneShapes or source.ndim not in (2, 3):
+                    raise ValueError(f'layer {i}: unexpected shape {source.shape} of {fmt} source, '
+                                     'expected (h, w[, c]) or a sequence of planes')
+                size = (source.shape[1], source.shape[0])
+                if not source[0].flags.c_contiguous:
+                    source = np.ascontiguousarray(source)
+                arrays = [source]
+            prepared.append((arrays, fourcc, size[0], size[1], x, y, width, height))
+
+        self._count_frame()
+
+        compose(prepared, pts)
+
+    def _count_frame(self) -> None:
+        with self._stats_lock:
+            self._frames_sent += 1
+            self._last_frame_t = time.perf_counter()
+            self._fps_counter.measure()
+
+            if self._print_fps and self._last_frame_t - self._fps_last_printed > 1:
+                self._fps_last_printed = self._last_frame_t
+                s = f'{self._fps_counter.avg_fps:.1f} fps'
+                
+                # If sleep_until_next_frame() is used, show percentage of frame time
+                # spent in computation (vs sleeping).
+                if self._extra_time_per_frame > 0:
+                    busy_ratio = min(1, self._extra_time_per_frame * self._fps)
+                    s += f' | {100*busy_ratio:.0f} %'
+                
+                print(s)
+
+    def send_many(self, frames: np.ndarray, timestamps: Optional[Sequence[float]]=None,
+                  pace: bool=True) -> Tuple[int, int]:
+        """Send a batch of frames to the virtual camera device.
+
+        Compared to calling :meth:`send` for each frame, the per-frame overhead
+        in Python is paid once per batch. The built-in backends convert, send
+        and pace the whole batch without holding the GIL. The frames of the batch
+        are sent in order, while frames sent from other threads meanwhile
+        may come in between them.
+
+        :param frames: Frames stacked along the first axis, for example an array
+            of shape ``(n, h, w, 3)`` for :attr:`PixelFormat.RGB`.
+            Frames of formats without a ``(h, w[, c])`` shape are stacked
+            into an array of shape ``(n, size)``.
+        :param timestamps: Presentation time of each frame in seconds, relative
+            to any origin. If ``None``, frames are ``1/fps`` seconds apart.
+        :param pace: Whether to wait until each frame is due before sending it,
+            starting with the first frame right away.
+            A frame is dropped if the next frame is due already,
+            so that the batch does not fall behind.
+            If ``False``, frames are sent as fast as possible and none are dropped.
+        :return: The number of frames sent and the number of frames dropped.
+        """
+        if frames.dtype != np.uint8:
+            raise TypeError(f'unexpected frame dtype: {frames.dtype} != uint8')
+        if frames.ndim < 2:
+            raise ValueError(f'unexpected batch shape: {frames.shape}')
+        if len(frames) > 0:
+            self._check_frame_shape(frames[0])
+        if self._is_packed_shape:
+            if len(frames) > 0 and not frames[0, 0].flags.c_contiguous:
+                frames = np.ascontiguousarray(frames)
+        else:
+            frames = np.ascontiguousarray(frames.reshape(len(frames), -1))
+        if timestamps is not None:
+            timestamps = np.asarray(timestamps, np.float64)
+            if timestamps.shape != (len(frames),):
+                raise ValueError(f'expected one timestamp per frame: {timestamps.shape} != {(len(frames),)}')
+
+        batch_send = getattr(self._backend, 'send_many', None)
+        if batch_send is not None and type(self._backend).send_many is not Backend.send_many:
+            sent, dropped = batch_send(frames, timestamps, pace)
+        else:
+            sent, dropped = self._send_many_one_by_one(frames, timestamps, pace)
+
+        with self._stats_lock:
+            self._frames_sent += sent
+            if sent > 0:
+                self._last_frame_t = time.perf_counter()
+                self._fps_counter.measure(sent)
+        return sent, dropped
+
+    def _send_many_one_by_one(self, frames: np.ndarray, timestamps: Optional[np.ndarray],
+                              pace: bool) -> Tuple[int, int]:
+        # Same schedule and drop rule as send_batch() in native_shared/frame_batch.h.
+        def due(i: int) -> float:
+            return timestamps[i] - timestamps[0] if timestamps is not None else i / self._fps
+        start = time.perf_counter()
+        sent = dropped = 0
+        for i, frame in enumerate(frames):
+            if pace:
+                if i + 1 < len(frames) and time.perf_counter() >= start + due(i + 1):
+                    dropped += 1
+                    continue
+                t_sleep = start + due(i) - time.perf_counter()
+                if t_sleep > 0:
+                    time.sleep(t_sleep)
+            self._backend.send(frame)
+            sent += 1
+        return sent, dropped
+
+    def _prepare_frame(self, frame: np.ndarray) -> np.ndarray:
         if frame.dtype != np.uint8:
             raise TypeError(f'unexpected frame dtype: {frame.dtype} != uint8')
         
         self._check_frame_shape(frame)
 
-        self._frames_sent += 1
-        self._last_frame_t = time.perf_counter()
-        self._fps_counter.measure()
-
-        if self._print_fps and self._last_frame_t - self._fps_last_printed > 1:
-            self._fps_last_printed = self._last_frame_t
-            s = f'{self._fps_counter.avg_fps:.1f} fps'
-            
-            # If sleep_until_next_frame() is used, show percentage of frame time
-            # spent in computation (vs sleeping).
-            if self._extra_time_per_frame > 0:
-                busy_ratio = min(1, self._extra_time_per_frame * self._fps)
-                s += f' | {100*busy_ratio:.0f} %'
-            
-            print(s)
-        
-        frame = np.asarray(frame.reshape(-1), order='C')
-        self._backend.send(frame)
-        
+        if self._is_packed_shape:
+            # Padded rows, like in a cropped view of a larger image,
+            # are handled by the backend without copying.
+            if not frame[0].flags.c_contiguous:
+                frame = np.ascontiguousarray(frame)
+        else:
+            frame = np.ascontiguousarray(frame.reshape(-1))
+        return frame
+
+    def _prepare_planes(self, planes: Sequence[np.ndarray], fmt: PixelFormat,
+                        size: Tuple[int, int]) -> List[np.ndarray]:
+        if fmt not in PlaneShapes:
+            raise ValueError(f'{fmt} frames cannot be sent as separate planes')
+        plane_shapes: List[Tuple[int, int]] = PlaneShapes[fmt](*size)
+        if len(planes) != len(plane_shapes):
+            raise ValueError(f'unexpected number of planes: {len(planes)} != {len(plane_shapes)}')
+        prepared = []
+        for i, (plane, (rows, row_size)) in enumerate(zip(planes, plane_shapes)):
+            if plane.dtype != np.uint8:
+                raise TypeError(f'unexpected dtype of plane {i}: {plane.dtype} != uint8')
+            if plane.ndim == 1:
+                if plane.size != rows * row_size:
+                    raise ValueError(f'unexpected size of plane {i}: {plane.size} != {rows * row_size}')
+                plane = np.ascontiguousarray(plane)
+            else:
+                if plane.shape[0] != rows or plane[0].size != row_size:
+                    raise ValueError(f'unexpected shape of plane {i}: {plane.shape}, '
+                                     f'expected {rows} rows of {row_size} bytes')
+                if not plane[0].flags.c_contiguous:
+                    plane = np.ascontiguousarray(plane)
+            prepared.append(plane)
+        return prepared
+
+    @property
+    def pacing_jitter(self) -> Optional[Tuple[float, float]]:
+        """ Mean and maximum time in milliseconds by which :meth:`sleep_until_next_frame`
+        returned after the next frame was due,
+        or ``None`` if the backend does not sleep natively.
+        """
+        jitter = getattr(self._backend, 'pacing_jitter', lambda: None)()
+        return None if jitter is None else tuple(jitter)
+
     @property
     def current_fps(self) -> float:
         """ Current measured frames per second. """
@@ -366,7 +981,18 @@ class Camera:
         As a side effect, it estimates the time spent in computation
         which is printed as a percentage if ``print_fps=True``
         is given as argument in the constructor.
+
+        The ``v4l2loopback`` backend sleeps natively instead, without holding the GIL,
+        until a fixed schedule of one frame per ``1/fps`` seconds
+        starting at the first call. Late wake-ups do not shift the schedule,
+        so there is no drift, see :attr:`pacing_jitter`. If the next frame is
+        overdue already, as producing it took longer than ``1/fps`` seconds,
+        it returns right away and the schedule starts over from then.
+        The percentage is not printed then.
         """
+        sleep = getattr(self._backend, 'sleep_until_next_frame', None)
+        if sleep is not None and sleep() is not False:
+            return
         next_frame_t = self._last_frame_t + 1 / self._fps
         current_t = time.perf_counter()
         if current_t < next_frame_t:
@@ -376,3 +1002,168 @@ class Camera:
             t_sleep = next_frame_t - current_t - self._extra_time_per_frame
             if t_sleep > 0:
                 time.sleep(t_sleep)
+
+class Output(NamedTuple):
+    """ An output of a :class:`~pyvirtualcam.MultiCamera`.
+    """
+
+    width: int
+    """ Frame width in pixels. """
+
+    height: int
+    """ Frame height in pixels. """
+
+    fmt: PixelFormat = PixelFormat.I420
+    """ Pixel format of the device: :attr:`PixelFormat.I420`, :attr:`PixelFormat.NV12`,
+    :attr:`PixelFormat.UYVY` or :attr:`PixelFormat.GRAY`. """
+
+    device: Optional[str] = None
+    """ The virtual camera device to use. If ``None``, the first available device is used. """
+
+class MultiCamera(Camera):
+    """
+    A virtual camera that sends each frame to several devices at once,
+    each with its own frame size and pixel format, like 1080p NV12 for a
+    video conference and a 360p I420 preview.
+
+    Compared to one :class:`~pyvirtualcam.Camera` per device, a frame is converted
+    only once to an I420 intermediate, see :attr:`native_fmt` and :attr:`conversion_path`.
+    Each distinct output size is scaled from the smallest larger one,
+    and outputs of the same size share their scaled planes, for example
+    the luma plane of I420, NV12 and GRAY outputs. Scaling and writing to the devices
+    run in parallel on the ``threads`` conversion threads.
+    Outputs nobody reads from are skipped, see :attr:`has_consumers`.
+
+    Only supported by the ``v4l2loopback`` backend.
+
+    :param width: Frame width of the input in pixels.
+    :param height: Frame height of the input in pixels.
+    :param fps: Target frame rate in frames per second.
+    :param outputs: The outputs, as :class:`~pyvirtualcam.Output` or
+        ``(width, height[, fmt[, device]])`` tuples.
+    :param fmt: Input pixel format.
+    :param backend: The virtual camera backend to use.
+        If ``None``, all available backends are tried.
+    :param print_fps: Print frame rate every second.
+    :param kw: Extra keyword arguments forwarded to the backend.
+        The ``v4l2loopback`` backend supports ``threads``, ``cpu_affinity``,
+        and ``buffers``, see :class:`~pyvirtualcam.Camera`.
+        ``buffers`` applies to each device.
+    """
+
+    _registry = MULTI_BACKENDS
+
+    def __init__(self, width: int, height: int, fps: float,
+                 outputs: Sequence[Union[Output, Tuple]], *,
+                 fmt: PixelFormat=PixelFormat.RGB,
+                 backend: Optional[str]=None,
+                 print_fps: bool=False,
+                 **kw) -> None:
+        outputs = [Output(*output) for output in outputs]
+        super().__init__(width, height, fps, fmt=fmt, backend=backend, print_fps=print_fps,
+                         outputs=[(output.width, output.height, encode_fourcc(output.fmt.value), output.device)
+                                  for output in outputs],
+                         **kw)
+        self._outputs = [output._replace(device=device)
+                         for output, device in zip(outputs, self._backend.devices())]
+
+    @property
+    def outputs(self) -> List[Output]:
+        """ The outputs, with the devices in use.
+        """
+        return list(self._outputs)
+
+    @property
+    def devices(self) -> List[str]:
+        """ The virtual camera devices in use, one per output.
+        :attr:`device` is the first of them.
+        """
+        return [output.device for output in self._outputs]
+
+class Tile(NamedTuple):
+    """ A tile of a :class:`~pyvirtualcam.MosaicCamera`.
+    """
+
+    x: int
+    """ Horizontal position of the left edge of the tile in the mosaic, in pixels. """
+
+    y: int
+    """ Vertical position of the top edge of the tile in the mosaic, in pixels. """
+
+    width: int
+    """ Frame width in pixels. """
+
+    height: int
+    """ Frame height in pixels. """
+
+    fmt: Optional[PixelFormat] = None
+    """ Pixel format of the device. If ``None``, it is chosen as for a
+    :class:`~pyvirtualcam.Camera` of the pixel format of the mosaic. """
+
+    device: Optional[str] = None
+    """ The virtual camera device to use. If ``None``, the first available device is used. """
+
+class MosaicCamera(Camera):
+    """
+    A virtual camera that sends each tile of a large frame, a mosaic, to a device of its own,
+    like a 4x4 grid of renderings published as 16 cameras.
+
+    Compared to one :class:`~pyvirtualcam.Camera` per tile, each sent a view of the mosaic,
+    the mosaic is passed to the backend once per frame, and the views are neither
+    copied nor sent from Python one by one. Each tile is converted straight from
+    the mosaic into its device, and tiles are converted and written in parallel
+    on the ``threads`` conversion threads.
+    Tiles nobody reads from are skipped, see :attr:`has_consumers`.
+
+    Only supported by the ``v4l2loopback`` backend.
+
+    :param width: Frame width of the mosaic in pixels.
+    :param height: Frame height of the mosaic in pixels.
+    :param fps: Target frame rate in frames per second.
+    :param tiles: The tiles, as :class:`~pyvirtualcam.Tile` or
+        ``(x, y, width, height[, fmt[, device]])`` tuples. Tiles must lie within the mosaic
+        and, in formats with subsampled chroma, have an even position and size.
+        They may overlap. For example, a grid of ``w`` x ``h`` tiles::
+
+            tiles = [(col * w, row * h, w, h) for row in range(rows) for col in range(cols)]
+
+    :param fmt: Pixel format of the mosaic.
+    :param backend: The virtual camera backend to use.
+        If ``None``, all available backends are tried.
+    :param print_fps: Print frame rate every second.
+    :param kw: Extra keyword arguments forwarded to the backend.
+        The ``v4l2loopback`` backend supports ``threads``, ``cpu_affinity``,
+        and ``buffers``, see :class:`~pyvirtualcam.Camera`.
+        ``buffers`` applies to each device.
+    """
+
+    _registry = MOSAIC_BACKENDS
+
+    def __init__(self, width: int, height: int, fps: float,
+                 tiles: Sequence[Union[Tile, Tuple]], *,
+                 fmt: PixelFormat=PixelFormat.RGB,
+                 backend: Optional[str]=None,
+                 print_fps: bool=False,
+                 **kw) -> None:
+        tiles = [Tile(*tile) for tile in tiles]
+        super().__init__(width, height, fps, fmt=fmt, backend=backend, print_fps=print_fps,
+                         tiles=[(tile.x, tile.y, tile.width, tile.height,
+                                 encode_fourcc(tile.fmt.value) if tile.fmt else 0, tile.device)
+                                for tile in tiles],
+                         **kw)
+        self._tiles = [tile._replace(fmt=PixelFormat(decode_fourcc(fourcc)), device=device)
+                       for tile, fourcc, device in zip(tiles, self._backend.native_fourccs(),
+                                                       self._backend.devices())]
+
+    @property
+    def tiles(self) -> List[Tile]:
+        """ The tiles, with the pixel formats and devices in use.
+        """
+        return list(self._tiles)
+
+    @property
+    def devices(self) -> List[str]:
+        """ The virtual camera devices in use, one per tile.
+        :attr:`device` is the first of them.
+        """
+        return [tile.device for tile in self._tiles]
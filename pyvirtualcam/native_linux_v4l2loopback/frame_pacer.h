@@ -0,0 +1,93 @@
+#pragma once
+
+#include <time.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+
+// Sleeps until the next frame is due, with frame n due at start + n / fps,
+// rounded for each frame instead of once for the period, so that rates like
+// 30000/1001 do not drift either. As due times do not depend on when the previous
+// wait returned, late wake-ups do not add up over time.
+// If a frame is overdue already, as the producer took longer than a period,
+// the wait returns right away and the schedule starts over from then,
+// so that a slow producer runs as fast as it can instead of skipping to the next slot.
+// Sleeping until an absolute time on the monotonic clock avoids the
+// rounding of relative sleeps.
+class FramePacer {
+  private:
+    double _fps;
+    int64_t _start_ns = -1;
+    int64_t _frame = 0;
+    std::mutex _mutex;
+    // How late each wait returned compared to the due time.
+    uint64_t _waits = 0;
+    double _lateness_sum_ns = 0;
+    int64_t _lateness_max_ns = 0;
+
+    static int64_t now_ns() {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    // Call with _mutex held.
+    void record(int64_t lateness_ns) {
+        _waits++;
+        _lateness_sum_ns += lateness_ns;
+        _lateness_max_ns = std::max(_lateness_max_ns, lateness_ns);
+    }
+
+  public:
+    explicit FramePacer(double fps) : _fps(fps) {
+        if (!(fps > 0)) {
+            throw std::invalid_argument("fps must be positive");
+        }
+    }
+
+    // Sleeps until the next frame is due.
+    // The schedule starts with the first call, which waits a whole period.
+    void wait() {
+        int64_t due_ns;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            int64_t now = now_ns();
+            if (_start_ns < 0) {
+                _start_ns = now;
+            }
+            _frame++;
+            due_ns = _start_ns + std::llround(_frame * 1e9 / _fps);
+            if (due_ns <= now) {
+                // The next frame is due a period from now.
+                _start_ns = now;
+                _frame = 0;
+                record(now - due_ns);
+                return;
+            }
+        }
+        timespec due;
+        due.tv_sec = due_ns / 1000000000;
+        due.tv_nsec = due_ns % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, nullptr) == EINTR) {
+        }
+        int64_t lateness_ns = now_ns() - due_ns;
+        std::lock_guard<std::mutex> lock(_mutex);
+        record(lateness_ns);
+    }
+
+    // Mean and maximum time in nanoseconds by which waits returned after the due time,
+    // including those that returned right away as the frame was overdue.
+    double mean_lateness_ns() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _waits ? _lateness_sum_ns / _waits : 0;
+    }
+
+    int64_t max_lateness_ns() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _lateness_max_ns;
+    }
+};
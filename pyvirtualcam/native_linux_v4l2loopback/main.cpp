@@ -1,48 +1,326 @@
+#include <cmath>
 #include <stdexcept>
 #include <optional>
+#include <tuple>
+#include <vector>
+#include <memory>
+#include <mutex>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
 #include "virtual_output.h"
+#include "multi_output.h"
+#include "mosaic_output.h"
+#include "frame_pacer.h"
+#include "../native_shared/camera_base.h"
 
 namespace py = pybind11;
 
-class Camera {
+class Camera : public CameraBase<VirtualOutput> {
   private:
-    VirtualOutput virtual_output;
+    FramePacer pacer;
 
   public:
-    Camera(uint32_t width, uint32_t height, [[maybe_unused]] double fps,
-           uint32_t fourcc, std::optional<std::string> device_)
-     : virtual_output {width, height, fourcc, device_} {
+    Camera(uint32_t width, uint32_t height, double fps,
+           uint32_t fourcc, std::optional<std::string> device_,
+           uint32_t threads, const std::vector<uint32_t>& cpu_affinity,
+           uint32_t buffers, bool passthrough,
+           bool sustain_framerate, uint32_t timeout, std::optional<py::array_t<uint8_t>> timeout_image,
+           size_t queue_depth, const std::string& drop_policy_,
+           size_t jitter_buffer_,
+           std::optional<std::tuple<uint32_t, uint32_t>> input_size,
+           const std::string& fit, const std::string& filter,
+           bool mirror, uint32_t rotate)
+     : CameraBase(width, height, fps, fourcc, queue_depth, drop_policy_, jitter_buffer_,
+                  input_size, fit, filter, mirror, rotate,
+                  width, height, fps, fourcc, device_, threads, cpu_affinity,
+                  buffers, passthrough, sustain_framerate, timeout),
+       pacer {fps} {
+        if (timeout_image) {
+            virtual_output.set_timeout_image(
+                numpy_frame_planes(*timeout_image, frame_fourcc, frame_width, frame_height));
+        }
+    }
+
+    // (device, name, fourcc, width, height) of each v4l2loopback device,
+    // see Backend.list_devices() in camera.py.
+    static std::vector<std::tuple<std::string, std::string, uint32_t, uint32_t, uint32_t>> list_devices() {
+        std::vector<std::tuple<std::string, std::string, uint32_t, uint32_t, uint32_t>> devices;
+        for (const LoopbackDevice& device : list_loopback_devices()) {
+            devices.emplace_back(device.path, device.name, device.fourcc, device.width, device.height);
+        }
+        return devices;
+    }
+
+    void sleep_until_next_frame() {
+        py::gil_scoped_release release;
+        pacer.wait();
+    }
+
+    // Mean and maximum time in milliseconds by which sleep_until_next_frame()
+    // returned after the next frame was due.
+    std::tuple<double, double> pacing_jitter() {
+        return { pacer.mean_lateness_ns() / 1e6, pacer.max_lateness_ns() / 1e6 };
+    }
+
+    // Keeps the last sent frame shown until the next one is sent,
+    // without it being sent again. Returns false if v4l2loopback does not support this.
+    // Frames sent before are passed on to the device first, as each of them
+    // would release the hold again.
+    bool hold_frame() {
+        py::gil_scoped_release release;
+        while (true) {
+            if (jitter_buffer) {
+                // Drained before locking send_mutex, which its thread locks to send a frame.
+                jitter_buffer->drain();
+            }
+            std::lock_guard<std::mutex> lock(send_mutex);
+            if (jitter_buffer && !jitter_buffer->empty()) {
+                // Another thread sent a frame meanwhile.
+                continue;
+            }
+            if (sender) {
+                sender->drain();
+            }
+            return virtual_output.hold_frame(true);
+        }
+    }
+
+    std::optional<bool> has_consumers() {
+        return virtual_output.has_consumers();
+    }
+};
+
+// Sends frames to several devices, each with its own size and format, see MultiOutput.
+class MultiCamera {
+  private:
+    MultiOutput multi_output;
+    uint32_t frame_fourcc;
+    int32_t frame_width;
+    int32_t frame_height;
+    // Serializes sending and closing, which run without the GIL.
+    std::mutex send_mutex;
+
+    static std::vector<OutputSpec> output_specs(
+            const std::optional<std::string>& device,
+            const std::vector<std::tuple<uint32_t, uint32_t, uint32_t, std::optional<std::string>>>& outputs) {
+        if (device) {
+            throw std::invalid_argument("Devices are given per output.");
+        }
+        std::vector<OutputSpec> specs;
+        for (const auto& [width, height, fourcc, output_device] : outputs) {
+            specs.push_back({ width, height, fourcc, output_device });
+        }
+        return specs;
+    }
+
+  public:
+    MultiCamera(uint32_t width, uint32_t height, double fps,
+                uint32_t fourcc, std::optional<std::string> device,
+                const std::vector<std::tuple<uint32_t, uint32_t, uint32_t, std::optional<std::string>>>& outputs,
+                uint32_t threads, const std::vector<uint32_t>& cpu_affinity,
+                uint32_t buffers)
+     : multi_output {width, height, fps, fourcc, output_specs(device, outputs),
+                     threads, cpu_affinity, buffers},
+       frame_fourcc {libyuv::CanonicalFourCC(fourcc)}, frame_width {int32_t(width)}, frame_height {int32_t(height)} {
     }
 
     void close() {
-        virtual_output.stop();
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(send_mutex);
+        multi_output.stop();
     }
 
+    // The device of the first output.
     std::string device() {
-        return virtual_output.device();
+        return multi_output.devices()[0];
     }
 
+    std::vector<std::string> devices() {
+        return multi_output.devices();
+    }
+
+    // The intermediate format all outputs are fed from.
     uint32_t native_fourcc() {
-        return virtual_output.native_fourcc();
+        return libyuv::FOURCC_I420;
     }
 
-    void send(py::array_t<uint8_t, py::array::c_style> frame) {
-        py::buffer_info buf = frame.request();    
-        virtual_output.send(static_cast<uint8_t*>(buf.ptr));
+    std::vector<std::string> conversion_path() {
+        return multi_output.conversion_plan().path();
+    }
+
+    double conversion_cost() {
+        return multi_output.conversion_plan().cost();
+    }
+
+    std::optional<bool> has_consumers() {
+        return multi_output.has_consumers();
+    }
+
+    void send_frame(const Planes& frame) {
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(send_mutex);
+        multi_output.send(frame);
+    }
+
+    void send(py::array_t<uint8_t> frame) {
+        send_frame(numpy_frame_planes(frame, frame_fourcc, frame_width, frame_height));
+    }
+
+    void send_planes(std::vector<py::array_t<uint8_t>> planes) {
+        send_frame(numpy_planes(planes, frame_fourcc, frame_width, frame_height));
     }
 };
 
-PYBIND11_MODULE(_native_linux_v4l2loopback, m) {
-    py::class_<Camera>(m, "Camera")
-        .def(py::init<uint32_t, uint32_t, double, uint32_t, std::optional<std::string>>(),
+// Sends each tile of a mosaic frame to a device of its own, see MosaicOutput.
+class MosaicCamera {
+  private:
+    MosaicOutput mosaic_output;
+    uint32_t frame_fourcc;
+    int32_t frame_width;
+    int32_t frame_height;
+    // Serializes sending and closing, which run without the GIL.
+    std::mutex send_mutex;
+
+    static std::vector<TileSpec> tile_specs(
+            const std::optional<std::string>& device,
+            const std::vector<std::tuple<int32_t, int32_t, int32_t, int32_t, uint32_t, std::optional<std::string>>>& tiles) {
+        if (device) {
+            throw std::invalid_argument("Devices are given per tile.");
+        }
+        std::vector<TileSpec> specs;
+        for (const auto& [x, y, width, height, fourcc, tile_device] : tiles) {
+            specs.push_back({ { x, y, width, height }, fourcc, tile_device });
+        }
+        return specs;
+    }
+
+  public:
+    MosaicCamera(uint32_t width, uint32_t height, double fps,
+                 uint32_t fourcc, std::optional<std::string> device,
+                 const std::vector<std::tuple<int32_t, int32_t, int32_t, int32_t, uint32_t, std::optional<std::string>>>& tiles,
+                 uint32_t threads, const std::vector<uint32_t>& cpu_affinity,
+                 uint32_t buffers)
+     : mosaic_output {width, height, fps, fourcc, tile_specs(device, tiles),
+                      threads, cpu_affinity, buffers},
+       frame_fourcc {libyuv::CanonicalFourCC(fourcc)}, frame_width {int32_t(width)}, frame_height {int32_t(height)} {
+    }
+
+    void close() {
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(send_mutex);
+        mosaic_output.stop();
+    }
+
+    // The device of the first tile.
+    std::string device() {
+        return mosaic_output.devices()[0];
+    }
+
+    std::vector<std::string> devices() {
+        return mosaic_output.devices();
+    }
+
+    // The native format of the first tile.
+    uint32_t native_fourcc() {
+        return mosaic_output.native_fourccs()[0];
+    }
+
+    std::vector<uint32_t> native_fourccs() {
+        return mosaic_output.native_fourccs();
+    }
+
+    std::vector<std::string> conversion_path() {
+        return mosaic_output.conversion_plan().path();
+    }
+
+    double conversion_cost() {
+        return mosaic_output.conversion_plan().cost();
+    }
+
+    std::optional<bool> has_consumers() {
+        return mosaic_output.has_consumers();
+    }
+
+    void send_frame(const Planes& frame) {
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(send_mutex);
+        mosaic_output.send(frame);
+    }
+
+    void send(py::array_t<uint8_t> frame) {
+        send_frame(numpy_frame_planes(frame, frame_fourcc, frame_width, frame_height));
+    }
+
+    void send_planes(std::vector<py::array_t<uint8_t>> planes) {
+        send_frame(numpy_planes(planes, frame_fourcc, frame_width, frame_height));
+    }
+};
+
+PYBIND11_MODULE(_native_linux_v4l2loopback, m, py::mod_gil_not_used()) {
+    py::class_<Camera> camera(m, "Camera");
+    camera
+        .def(py::init<uint32_t, uint32_t, double, uint32_t, std::optional<std::string>,
+                      uint32_t, const std::vector<uint32_t>&, uint32_t, bool,
+                      bool, uint32_t, std::optional<py::array_t<uint8_t>>,
+                      size_t, const std::string&, size_t,
+                      std::optional<std::tuple<uint32_t, uint32_t>>, const std::string&, const std::string&,
+                      bool, uint32_t>(),
+             py::kw_only(),
+             py::arg("width"), py::arg("height"), py::arg("fps"),
+             py::arg("fourcc"), py::arg("device"),
+             py::arg("threads") = 1, py::arg("cpu_affinity") = std::vector<uint32_t>(),
+             py::arg("buffers") = 0,
+             py::arg("passthrough") = false,
+             py::arg("sustain_framerate") = false, py::arg("timeout") = 0,
+             py::arg("timeout_image") = py::none(),
+             py::arg("queue_depth") = 0, py::arg("drop_policy") = "drop_oldest",
+             py::arg("jitter_buffer") = 0,
+             py::arg("input_size") = py::none(), py::arg("fit") = "stretch", py::arg("filter") = "box",
+             py::arg("mirror") = false, py::arg("rotate") = 0)
+        .def_static("list_devices", &Camera::list_devices)
+        .def("sleep_until_next_frame", &Camera::sleep_until_next_frame)
+        .def("pacing_jitter", &Camera::pacing_jitter)
+        .def("hold_frame", &Camera::hold_frame)
+        .def("has_consumers", &Camera::has_consumers);
+    def_camera_base(camera);
+
+    py::class_<MultiCamera>(m, "MultiCamera")
+        .def(py::init<uint32_t, uint32_t, double, uint32_t, std::optional<std::string>,
+                      const std::vector<std::tuple<uint32_t, uint32_t, uint32_t, std::optional<std::string>>>&,
+                      uint32_t, const std::vector<uint32_t>&, uint32_t>(),
+             py::kw_only(),
+             py::arg("width"), py::arg("height"), py::arg("fps"),
+             py::arg("fourcc"), py::arg("device"), py::arg("outputs"),
+             py::arg("threads") = 1, py::arg("cpu_affinity") = std::vector<uint32_t>(),
+             py::arg("buffers") = 0)
+        .def("close", &MultiCamera::close)
+        .def("send", &MultiCamera::send)
+        .def("send_planes", &MultiCamera::send_planes)
+        .def("device", &MultiCamera::device)
+        .def("devices", &MultiCamera::devices)
+        .def("native_fourcc", &MultiCamera::native_fourcc)
+        .def("conversion_path", &MultiCamera::conversion_path)
+        .def("conversion_cost", &MultiCamera::conversion_cost)
+        .def("has_consumers", &MultiCamera::has_consumers);
+
+    py::class_<MosaicCamera>(m, "MosaicCamera")
+        .def(py::init<uint32_t, uint32_t, double, uint32_t, std::optional<std::string>,
+                      const std::vector<std::tuple<int32_t, int32_t, int32_t, int32_t, uint32_t, std::optional<std::string>>>&,
+                      uint32_t, const std::vector<uint32_t>&, uint32_t>(),
              py::kw_only(),
              py::arg("width"), py::arg("height"), py::arg("fps"),
-             py::arg("fourcc"), py::arg("device"))
-        .def("close", &Camera::close)
-        .def("send", &Camera::send)
-        .def("device", &Camera::device)
-        .def("native_fourcc", &Camera::native_fourcc);
+             py::arg("fourcc"), py::arg("device"), py::arg("tiles"),
+             py::arg("threads") = 1, py::arg("cpu_affinity") = std::vector<uint32_t>(),
+             py::arg("buffers") = 0)
+        .def("close", &MosaicCamera::close)
+        .def("send", &MosaicCamera::send)
+        .def("send_planes", &MosaicCamera::send_planes)
+        .def("device", &MosaicCamera::device)
+        .def("devices", &MosaicCamera::devices)
+        .def("native_fourcc", &MosaicCamera::native_fourcc)
+        .def("native_fourccs", &MosaicCamera::native_fourccs)
+        .def("conversion_path", &MosaicCamera::conversion_path)
+        .def("conversion_cost", &MosaicCamera::conversion_cost)
+        .def("has_consumers", &MosaicCamera::has_consumers);
 }
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "virtual_output.h"
+#include "../native_shared/frame_scaler.h"
+
+// Region, native format and device of one tile of a MosaicOutput.
+// A native format of 0 is chosen as for a camera of the format of the mosaic.
+struct TileSpec {
+    FrameRect rect;
+    uint32_t fourcc;
+    std::optional<std::string> device;
+};
+
+// Sends each tile of a mosaic frame, like a 4x4 grid of renderings, to a v4l2loopback device of its own.
+//
+// Each tile is a view of the mosaic, its planes pointing into those of the mosaic
+// with the strides of the mosaic, so that it is converted straight from the mosaic
+// into the device without being copied out first. Tiles are converted and written
+// in parallel on the threads of one pool.
+class MosaicOutput {
+  private:
+    const FormatInfo& _format;
+    std::vector<FrameRect> _rects;
+    std::vector<std::unique_ptr<VirtualOutput>> _outputs;
+    std::unique_ptr<ThreadPool> _pool;
+    // Per frame: tiles that somebody reads from.
+    std::vector<size_t> _tasks;
+
+  public:
+    MosaicOutput(uint32_t width, uint32_t height, double fps, uint32_t fourcc,
+                 const std::vector<TileSpec>& tiles,
+                 uint32_t threads, const std::vector<uint32_t>& cpu_affinity,
+                 uint32_t buffers)
+        : _format(format_info(libyuv::CanonicalFourCC(fourcc))) {
+        if (tiles.empty()) {
+            throw std::invalid_argument("At least one tile is required.");
+        }
+        for (size_t i = 0; i < tiles.size(); i++) {
+            check_rect(_format, tiles[i].rect, int32_t(width), int32_t(height), "Tile " + std::to_string(i));
+            _rects.push_back(tiles[i].rect);
+        }
+        _pool = std::make_unique<ThreadPool>(threads, cpu_affinity);
+
+        for (const TileSpec& tile : tiles) {
+            // Each tile is written on a thread of the pool, so it needs no threads of its own.
+            _outputs.push_back(std::make_unique<VirtualOutput>(
+                tile.rect.width, tile.rect.height, fps, _format.fourcc, tile.device,
+                1, std::vector<uint32_t>(), buffers, false, false, 0,
+                tile.fourcc));
+        }
+    }
+
+    void stop() {
+        for (auto& output : _outputs) {
+            output->stop();
+        }
+    }
+
+    void send(const Planes& frame) {
+        // Tiles nobody would see are neither converted nor written.
+        _tasks.clear();
+        for (size_t i = 0; i < _outputs.size(); i++) {
+            if (_outputs[i]->wants_frames()) {
+                _tasks.push_back(i);
+            }
+        }
+        _pool->run(_tasks.size(), [&](size_t task) {
+            size_t i = _tasks[task];
+            _outputs[i]->send(rect_planes(_format, frame, _rects[i]));
+        });
+    }
+
+    std::vector<std::string> devices() {
+        std::vector<std::string> names;
+        for (auto& output : _outputs) {
+            names.push_back(output->device());
+        }
+        return names;
+    }
+
+    // Native format of each tile.
+    std::vector<uint32_t> native_fourccs() {
+        std::vector<uint32_t> fourccs;
+        for (auto& output : _outputs) {
+            fourccs.push_back(output->native_fourcc());
+        }
+        return fourccs;
+    }
+
+    // Whether a consumer is reading from any of the devices,
+    // or nothing if that is not known for all of them.
+    std::optional<bool> has_consumers() {
+        bool known = true;
+        for (auto& output : _outputs) {
+            std::optional<bool> consumers = output->has_consumers();
+            if (consumers.value_or(false)) {
+                return true;
+            }
+            known = known && consumers.has_value();
+        }
+        return known ? std::optional<bool>(false) : std::nullopt;
+    }
+
+    // The conversion of the first tile.
+    const ConversionPlan& conversion_plan() {
+        return _outputs[0]->conversion_plan();
+    }
+};
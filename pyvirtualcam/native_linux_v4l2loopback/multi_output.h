@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "virtual_output.h"
+
+// Size, native format and device of one output of a MultiOutput.
+struct OutputSpec {
+    uint32_t width;
+    uint32_t height;
+    uint32_t fourcc;
+    std::optional<std::string> device;
+};
+
+// Sends each frame to several v4l2loopback devices, each with its own size and format.
+//
+// A frame is converted once to I420, the intermediate all outputs are fed from,
+// and scaled in a pyramid: each distinct output size is a level scaled from
+// the smallest larger level, so that e.g. 360p is scaled from 720p rather than from 1080p.
+// Outputs of the same size share the planes of their level, e.g. the luma plane
+// of I420, NV12 and GRAY outputs, and only differ in how it is written into their device.
+//
+// The planes of all levels of the same depth in the pyramid are scaled in parallel,
+// and all outputs are written in parallel, on the threads of one pool.
+class MultiOutput {
+  private:
+    // A size in the pyramid, with its I420 frame.
+    struct Level {
+        int32_t width;
+        int32_t height;
+        // The level it is scaled from. The first level is the input itself.
+        size_t source;
+        // Number of scaling steps from the input.
+        size_t depth;
+        std::vector<uint8_t> buffer;
+        Planes planes;
+    };
+
+    uint32_t _frame_fourcc;
+    int32_t _frame_width;
+    int32_t _frame_height;
+    // From the input format to I420, unused if the input is I420 already.
+    ConversionPlan _plan;
+    std::vector<Level> _levels;
+    size_t _max_depth = 0;
+    std::vector<std::unique_ptr<VirtualOutput>> _outputs;
+    std::vector<size_t> _output_levels;
+    std::unique_ptr<ThreadPool> _pool;
+    // Per frame: number of planes of each level that are needed, 0 if none.
+    // GRAY outputs only need luma.
+    std::vector<int> _planes_needed;
+    // Per frame: (level, plane) pairs scaled in parallel.
+    std::vector<std::pair<size_t, int>> _tasks;
+
+    size_t find_level(int32_t width, int32_t height) {
+        for (size_t i = 0; i < _levels.size(); i++) {
+            if (_levels[i].width == width && _levels[i].height == height) {
+                return i;
+            }
+        }
+        return _levels.size();
+    }
+
+    void scale_plane(const Level& level, int plane) {
+        const Level& source = _levels[level.source];
+        int shift = plane == 0 ? 0 : 1;
+        libyuv::ScalePlane(
+            source.planes.data[plane], source.planes.stride[plane],
+            plane_row_size(libyuv::FOURCC_I420, plane, source.width), source.height >> shift,
+            level.planes.data[plane], level.planes.stride[plane],
+            plane_row_size(libyuv::FOURCC_I420, plane, level.width), level.height >> shift,
+            libyuv::kFilterBox);
+    }
+
+  public:
+    MultiOutput(uint32_t width, uint32_t height, double fps, uint32_t fourcc,
+                const std::vector<OutputSpec>& outputs,
+                uint32_t threads, const std::vector<uint32_t>& cpu_affinity,
+                uint32_t buffers)
+        : _frame_fourcc(libyuv::CanonicalFourCC(fourcc)),
+          _frame_width(width), _frame_height(height) {
+        if (outputs.empty()) {
+            throw std::invalid_argument("At least one output is required.");
+        }
+        _pool = std::make_unique<ThreadPool>(threads, cpu_affinity);
+        if (_frame_fourcc != libyuv::FOURCC_I420) {
+            _plan = ConversionPlan(_frame_fourcc, libyuv::FOURCC_I420, width, height);
+        }
+
+        // The input is the first level, the other sizes follow from the largest to the smallest.
+        _levels.push_back({ int32_t(width), int32_t(height), 0, 0, {}, {} });
+        std::vector<const OutputSpec*> by_area;
+        for (const OutputSpec& output : outputs) {
+            if (output.width == 0 || output.height == 0) {
+                throw std::invalid_argument("Output width and height must be positive.");
+            }
+            by_area.push_back(&output);
+        }
+        std::stable_sort(by_area.begin(), by_area.end(), [](const OutputSpec* a, const OutputSpec* b) {
+            return uint64_t(a->width) * a->height > uint64_t(b->width) * b->height;
+        });
+        for (const OutputSpec* output : by_area) {
+            int32_t level_width = output->width;
+            int32_t level_height = output->height;
+            if (find_level(level_width, level_height) < _levels.size()) {
+                continue;
+            }
+            // The smallest level at least as large in both dimensions, or the input
+            // if the output is scaled up. Levels that are themselves scaled up from
+            // the input hold no more detail than it and are not scaled down from.
+            size_t source = 0;
+            for (size_t i = 1; i < _levels.size(); i++) {
+                const Level& candidate = _levels[i];
+                bool fits = candidate.width >= level_width && candidate.height >= level_height;
+                bool downscaled = candidate.width <= int32_t(width) && candidate.height <= int32_t(height);
+                if (fits && downscaled &&
+                    int64_t(candidate.width) * candidate.height <
+                    int64_t(_levels[source].width) * _levels[source].height) {
+                    source = i;
+                }
+            }
+            Level level { level_width, level_height, source, _levels[source].depth + 1, {}, {} };
+            level.buffer.resize(frame_size(libyuv::FOURCC_I420, level_width, level_height));
+            level.planes = frame_planes(libyuv::FOURCC_I420, level.buffer.data(), level_width, level_height);
+            _max_depth = std::max(_max_depth, level.depth);
+            _levels.push_back(std::move(level));
+        }
+        if (_frame_fourcc != libyuv::FOURCC_I420) {
+            Level& input = _levels[0];
+            input.buffer.resize(frame_size(libyuv::FOURCC_I420, width, height));
+            input.planes = frame_planes(libyuv::FOURCC_I420, input.buffer.data(), width, height);
+        }
+        _planes_needed.resize(_levels.size());
+
+        for (const OutputSpec& output : outputs) {
+            // Each output is written on a thread of the pool, so it needs no threads of its own.
+            _outputs.push_back(std::make_unique<VirtualOutput>(
+                output.width, output.height, fps, libyuv::FOURCC_I420, output.device,
+                1, std::vector<uint32_t>(), buffers, false, false, 0,
+                output.fourcc));
+            _output_levels.push_back(find_level(output.width, output.height));
+        }
+    }
+
+    void stop() {
+        for (auto& output : _outputs) {
+            output->stop();
+        }
+    }
+
+    void send(const Planes& frame) {
+        // Levels nobody would see are neither converted nor scaled.
+        std::fill(_planes_needed.begin(), _planes_needed.end(), 0);
+        for (size_t i = 0; i < _outputs.size(); i++) {
+            if (_outputs[i]->wants_frames()) {
+                int planes = _outputs[i]->native_fourcc() == libyuv::FOURCC_J400 ? 1 : 3;
+                size_t level = _output_levels[i];
+                _planes_needed[level] = std::max(_planes_needed[level], planes);
+            }
+        }
+        // Sources come before the levels scaled from them.
+        for (size_t i = _levels.size() - 1; i > 0; i--) {
+            int& source_needed = _planes_needed[_levels[i].source];
+            source_needed = std::max(source_needed, _planes_needed[i]);
+        }
+        if (_planes_needed[0] == 0) {
+            return;
+        }
+
+        if (_frame_fourcc == libyuv::FOURCC_I420) {
+            _levels[0].planes = frame;
+        } else {
+            _plan(frame, _levels[0].planes, _pool.get());
+        }
+        for (size_t depth = 1; depth <= _max_depth; depth++) {
+            _tasks.clear();
+            for (size_t i = 1; i < _levels.size(); i++) {
+                for (int plane = 0; _levels[i].depth == depth && plane < _planes_needed[i]; plane++) {
+                    _tasks.emplace_back(i, plane);
+                }
+            }
+            _pool->run(_tasks.size(), [this](size_t task) {
+                scale_plane(_levels[_tasks[task].first], _tasks[task].second);
+            });
+        }
+        _pool->run(_outputs.size(), [&](size_t i) {
+            _outputs[i]->send(_levels[_output_levels[i]].planes);
+        });
+    }
+
+    std::vector<std::string> devices() {
+        std::vector<std::string> names;
+        for (auto& output : _outputs) {
+            names.push_back(output->device());
+        }
+        return names;
+    }
+
+    // Whether a consumer is reading from any of the devices,
+    // or nothing if that is not known for all of them.
+    std::optional<bool> has_consumers() {
+        bool known = true;
+        for (auto& output : _outputs) {
+            std::optional<bool> consumers = output->has_consumers();
+            if (consumers.value_or(false)) {
+                return true;
+            }
+            known = known && consumers.has_value();
+        }
+        return known ? std::optional<bool>(false) : std::nullopt;
+    }
+
+    const ConversionPlan& conversion_plan() {
+        return _plan;
+    }
+};
@@ -5,16 +5,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <linux/videodev2.h>
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <memory>
 #include <set>
+#include <mutex>
+#include <atomic>
+#include <optional>
 #include <stdexcept>
 
-#include "../native_shared/image_formats.h"
+#include "../native_shared/conversion_graph.h"
+#include "../native_shared/overlay.h"
 
 // v4l2loopback allows opening a device multiple times.
 // To avoid selecting the same device more than once,
@@ -23,6 +34,171 @@
 // or if devices are opened by other tools.
 // In this case, explicitly specifying the device seems the only solution.
 static std::set<std::string> ACTIVE_DEVICES;
+// Guards ACTIVE_DEVICES, as cameras may be created and closed on different threads.
+static std::mutex ACTIVE_DEVICES_MUTEX;
+
+// Added in Linux 5.2, missing in the headers of older build environments.
+#ifndef V4L2_PIX_FMT_RGBA32
+#define V4L2_PIX_FMT_RGBA32 v4l2_fourcc('A', 'B', '2', '4')
+#endif
+
+// Added in v4l2loopback 0.13, see v4l2loopback.h. Queued whenever the number
+// of consumers changes, with the new number as payload.
+#ifndef V4L2_EVENT_PRI_CLIENT_USAGE
+#define V4L2_EVENT_PRI_CLIENT_USAGE V4L2_EVENT_PRIVATE_START
+struct v4l2_event_client_usage {
+    __u32 count;
+};
+#endif
+
+// Controls of v4l2loopback, see v4l2loopback.h.
+#ifndef V4L2LOOPBACK_CID_BASE
+#define V4L2LOOPBACK_CID_BASE (V4L2_CID_USER_BASE | 0xf000)
+#define V4L2LOOPBACK_CID_KEEP_FORMAT (V4L2LOOPBACK_CID_BASE + 0)
+#define V4L2LOOPBACK_CID_SUSTAIN_FRAMERATE (V4L2LOOPBACK_CID_BASE + 1)
+#define V4L2LOOPBACK_CID_TIMEOUT (V4L2LOOPBACK_CID_BASE + 2)
+#define V4L2LOOPBACK_CID_TIMEOUT_IMAGE_IO (V4L2LOOPBACK_CID_BASE + 3)
+#endif
+
+// V4L2 pixel format of a native format, or 0 if there is none.
+static uint32_t v4l2_pixel_format(uint32_t fourcc) {
+    switch (fourcc) {
+        case libyuv::FOURCC_J400: return V4L2_PIX_FMT_GREY;
+        case libyuv::FOURCC_I420: return V4L2_PIX_FMT_YUV420;
+        case libyuv::FOURCC_NV12: return V4L2_PIX_FMT_NV12;
+        case libyuv::FOURCC_I422: return V4L2_PIX_FMT_YUV422P;
+        case libyuv::FOURCC_YUY2: return V4L2_PIX_FMT_YUYV;
+        case libyuv::FOURCC_UYVY: return V4L2_PIX_FMT_UYVY;
+        case libyuv::FOURCC_RAW: return V4L2_PIX_FMT_RGB24;
+        case libyuv::FOURCC_24BG: return V4L2_PIX_FMT_BGR24;
+        case libyuv::FOURCC_ABGR: return V4L2_PIX_FMT_RGBA32;
+        default: return 0;
+    }
+}
+
+// A v4l2loopback device as described in sysfs.
+struct LoopbackDevice {
+    uint32_t number;
+    // /dev/video<number>
+    std::string path;
+    // The card label, as given to v4l2loopback with card_label=...
+    std::string name;
+    // libyuv FourCC and size of the current format,
+    // 0 if no format is set yet or it is not one of ours.
+    uint32_t fourcc = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+static constexpr const char* SYSFS_VIDEO4LINUX = "/sys/class/video4linux";
+
+static bool read_sysfs_attribute(const std::string& path, std::string& value) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        return false;
+    }
+    char buffer[256];
+    size_t size = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    value.assign(buffer, size);
+    while (!value.empty() && isspace(static_cast<unsigned char>(value.back()))) {
+        value.pop_back();
+    }
+    return true;
+}
+
+// Parses the format attribute of v4l2loopback, like "YU12:1280x720@30".
+static void parse_loopback_format(const std::string& format, LoopbackDevice& device) {
+    unsigned int width, height;
+    if (format.size() < 5 || format[4] != ':' ||
+        sscanf(format.c_str() + 5, "%ux%u", &width, &height) != 2) {
+        return;
+    }
+    uint32_t pixel_format = v4l2_fourcc(format[0], format[1], format[2], format[3]);
+    for (uint32_t fourcc : { libyuv::FOURCC_J400, libyuv::FOURCC_I420, libyuv::FOURCC_NV12,
+                             libyuv::FOURCC_I422, libyuv::FOURCC_YUY2, libyuv::FOURCC_UYVY,
+                             libyuv::FOURCC_RAW, libyuv::FOURCC_24BG, libyuv::FOURCC_ABGR }) {
+        if (v4l2_pixel_format(fourcc) == pixel_format) {
+            device.fourcc = fourcc;
+        }
+    }
+    device.width = width;
+    device.height = height;
+}
+
+// Lists v4l2loopback devices from sysfs, ordered by number, without opening any device.
+// Returns false if sysfs is not available, like in some containers.
+static bool scan_loopback_devices(std::vector<LoopbackDevice>& devices) {
+    DIR* dir = opendir(SYSFS_VIDEO4LINUX);
+    if (!dir) {
+        return false;
+    }
+    while (dirent* entry = readdir(dir)) {
+        unsigned int number;
+        char rest;
+        if (sscanf(entry->d_name, "video%u%c", &number, &rest) != 1) {
+            continue;
+        }
+        std::string base = std::string(SYSFS_VIDEO4LINUX) + "/" + entry->d_name + "/";
+        // Only v4l2loopback devices have this attribute.
+        if (access((base + "max_openers").c_str(), F_OK) != 0) {
+            continue;
+        }
+        LoopbackDevice device;
+        device.number = number;
+        device.path = std::string("/dev/") + entry->d_name;
+        read_sysfs_attribute(base + "name", device.name);
+        std::string format;
+        if (read_sysfs_attribute(base + "format", format)) {
+            parse_loopback_format(format, device);
+        }
+        devices.push_back(device);
+    }
+    closedir(dir);
+    std::sort(devices.begin(), devices.end(), [](const LoopbackDevice& a, const LoopbackDevice& b) {
+        return a.number < b.number;
+    });
+    return true;
+}
+
+// Paths of the devices found by the last scan, so that creating a camera
+// does not scan sysfs again unless all of them are in use.
+// Guarded by ACTIVE_DEVICES_MUTEX.
+static std::vector<std::string> LOOPBACK_DEVICES;
+
+// Scans sysfs and updates LOOPBACK_DEVICES. Call with ACTIVE_DEVICES_MUTEX held.
+static bool rescan_loopback_devices(std::vector<LoopbackDevice>& devices) {
+    if (!scan_loopback_devices(devices)) {
+        return false;
+    }
+    LOOPBACK_DEVICES.clear();
+    for (const LoopbackDevice& device : devices) {
+        LOOPBACK_DEVICES.push_back(device.path);
+    }
+    return true;
+}
+
+static std::vector<LoopbackDevice> list_loopback_devices() {
+    std::vector<LoopbackDevice> devices;
+    std::lock_guard<std::mutex> lock(ACTIVE_DEVICES_MUTEX);
+    rescan_loopback_devices(devices);
+    return devices;
+}
+
+// Time per frame as a fraction, with the frame rate rounded to three decimals.
+static void set_timeperframe(double fps, v4l2_fract& timeperframe) {
+    uint32_t numerator = 1000;
+    uint32_t denominator = uint32_t(std::lround(fps * 1000));
+    uint32_t divisor = std::gcd(numerator, denominator);
+    timeperframe.numerator = numerator / divisor;
+    timeperframe.denominator = denominator / divisor;
+}
+
+// A buffer of the device mapped into our memory for streaming I/O.
+struct MappedBuffer {
+    uint8_t* data;
+    size_t length;
+};
 
 class VirtualOutput {
   private:
@@ -35,61 +211,236 @@ class VirtualOutput {
     uint32_t _frame_height;
     uint32_t _out_frame_size;
     std::vector<uint8_t> _buffer_output;
+    ConversionPlan _plan;
+    OverlaySlot _overlay;
+    std::unique_ptr<ThreadPool> _pool;
+    // Empty if streaming I/O is not used and frames are written with write().
+    std::vector<MappedBuffer> _mapped_buffers;
+    // Indices of mapped buffers that are not queued to the driver.
+    std::vector<uint32_t> _free_buffers;
+    bool _streaming = false;
+    // Whether v4l2loopback tells us about consumers, and how many there are.
+    bool _client_usage_events = false;
+    uint32_t _consumers = 0;
+    // Guards _consumers and reading events, as sending may happen on a sender thread
+    // while the state is queried on another one.
+    std::mutex _consumers_mutex;
+    // Control values given by the user, restored when a held frame is released.
+    bool _sustain_framerate = false;
+    uint32_t _timeout = 0;
+    // Whether the last sent frame is held, see hold_frame().
+    // Guarded by _hold_mutex, as frames may be sent on a sender thread.
+    bool _held = false;
+    std::mutex _hold_mutex;
+    // The first frame is always sent, as consumers cannot open the device
+    // before a format is set and a frame was written (with exclusive_caps=1).
+    std::atomic<bool> _sent_frame {false};
+
+    bool set_control(uint32_t id, int32_t value) {
+        v4l2_control control;
+        memset(&control, 0, sizeof(control));
+        control.id = id;
+        control.value = value;
+        return ioctl(_camera_fd, VIDIOC_S_CTRL, &control) != -1;
+    }
+
+    // Planes of the output buffer, which is allocated on first use
+    // as frames that need no conversion are normally written directly.
+    Planes output_planes() {
+        _buffer_output.resize(_out_frame_size);
+        return frame_planes(_native_fourcc, _buffer_output.data(), _frame_width, _frame_height);
+    }
+
+    // Requests and maps `count` buffers, so that frames are converted
+    // straight into memory shared with the driver instead of being copied by write().
+    // v4l2loopback copies frames out of our memory while queueing them with
+    // V4L2_MEMORY_USERPTR, so handing over the sent arrays would not save a copy.
+    // Returns false if the device does not support this or uses another
+    // buffer layout, in which case frames are written with write().
+    bool start_streaming(uint32_t count, const v4l2_pix_format& pix) {
+        if (pix.bytesperline != uint32_t(plane_row_size(_native_fourcc, 0, _frame_width)) ||
+            pix.sizeimage < _out_frame_size) {
+            return false;
+        }
+        v4l2_requestbuffers request;
+        memset(&request, 0, sizeof(request));
+        request.count = count;
+        request.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        request.memory = V4L2_MEMORY_MMAP;
+        if (ioctl(_camera_fd, VIDIOC_REQBUFS, &request) == -1 || request.count == 0) {
+            return false;
+        }
+        // The driver may give us fewer or more buffers than requested.
+        for (uint32_t i = 0; i < request.count; i++) {
+            v4l2_buffer buffer;
+            memset(&buffer, 0, sizeof(buffer));
+            buffer.index = i;
+            buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+            buffer.memory = V4L2_MEMORY_MMAP;
+            void* data = MAP_FAILED;
+            if (ioctl(_camera_fd, VIDIOC_QUERYBUF, &buffer) != -1 && buffer.length >= _out_frame_size) {
+                data = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            _camera_fd, buffer.m.offset);
+            }
+            if (data == MAP_FAILED) {
+                stop_streaming();
+                return false;
+            }
+            _mapped_buffers.push_back({static_cast<uint8_t*>(data), buffer.length});
+            _free_buffers.push_back(i);
+        }
+        return true;
+    }
+
+    void stop_streaming() {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        if (_streaming) {
+            ioctl(_camera_fd, VIDIOC_STREAMOFF, &type);
+            _streaming = false;
+        }
+        for (const MappedBuffer& buffer : _mapped_buffers) {
+            munmap(buffer.data, buffer.length);
+        }
+        _mapped_buffers.clear();
+        _free_buffers.clear();
+        // Releases the buffers of the driver.
+        v4l2_requestbuffers request;
+        memset(&request, 0, sizeof(request));
+        request.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        request.memory = V4L2_MEMORY_MMAP;
+        ioctl(_camera_fd, VIDIOC_REQBUFS, &request);
+    }
+
+    // Index of a buffer we may write the next frame into, or -1 on error.
+    int acquire_buffer() {
+        if (!_free_buffers.empty()) {
+            uint32_t index = _free_buffers.back();
+            _free_buffers.pop_back();
+            return index;
+        }
+        v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        if (ioctl(_camera_fd, VIDIOC_DQBUF, &buffer) == -1) {
+            return -1;
+        }
+        return buffer.index;
+    }
+
+    // Hands a buffer holding a frame over to the driver.
+    // `timestamp_ns` is on the monotonic clock, like the timestamps v4l2loopback sets itself.
+    bool queue_buffer(uint32_t index, int64_t timestamp_ns) {
+        v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.index = index;
+        buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.bytesused = _out_frame_size;
+        buffer.field = V4L2_FIELD_NONE;
+        // A zero timestamp is replaced by the current time by v4l2loopback.
+        buffer.timestamp.tv_sec = timestamp_ns / 1000000000;
+        buffer.timestamp.tv_usec = (timestamp_ns % 1000000000) / 1000;
+        if (ioctl(_camera_fd, VIDIOC_QBUF, &buffer) == -1) {
+            _free_buffers.push_back(index);
+            return false;
+        }
+        if (!_streaming) {
+            // Streaming starts with the first queued frame, as before it there is nothing to show.
+            int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+            if (ioctl(_camera_fd, VIDIOC_STREAMON, &type) == -1) {
+                return false;
+            }
+            _streaming = true;
+        }
+        return true;
+    }
+
+    void send_streaming(const Planes& frame, int64_t timestamp_ns, const Overlay* overlay) {
+        int index = acquire_buffer();
+        if (index == -1) {
+            // not an exception, in case it is temporary
+            fprintf(stderr, "error dequeuing buffer: %s", strerror(errno));
+            return;
+        }
+        Planes out_planes = frame_planes(_native_fourcc, _mapped_buffers[index].data,
+                                         _frame_width, _frame_height);
+        _plan(frame, out_planes, _pool.get());
+        if (overlay) {
+            overlay->blend(out_planes);
+        }
+        if (!queue_buffer(index, timestamp_ns)) {
+            fprintf(stderr, "error queuing buffer: %s", strerror(errno));
+        }
+    }
 
   public:
-    VirtualOutput(uint32_t width, uint32_t height, uint32_t fourcc,
-                  std::optional<std::string> device_) {
+    VirtualOutput(uint32_t width, uint32_t height, double fps, uint32_t fourcc,
+                  std::optional<std::string> device_,
+                  uint32_t threads, const std::vector<uint32_t>& cpu_affinity,
+                  uint32_t buffers, bool passthrough,
+                  bool sustain_framerate, uint32_t timeout, uint32_t native_fourcc = 0) {
+        // Checked before the device is opened, as it is passed on as a fraction.
+        if (!(fps > 0)) {
+            throw std::invalid_argument("fps must be positive");
+        }
+        _pool = std::make_unique<ThreadPool>(threads, cpu_affinity);
         _frame_width = width;
         _frame_height = height;
         _frame_fourcc = libyuv::CanonicalFourCC(fourcc);
         
-        uint32_t out_frame_fmt_v4l;
+        // Native formats to try, in order.
+        std::vector<uint32_t> native_fourccs;
 
         switch (_frame_fourcc) {
             case libyuv::FOURCC_RAW:
             case libyuv::FOURCC_24BG:
+                // Passed through only if asked for, as many consumers support YUV formats only.
+                if (passthrough) {
+                    native_fourccs.push_back(_frame_fourcc);
+                }
                 // RGB|BGR -> I420
-                _out_frame_size = i420_frame_size(width, height);
-                _buffer_output.resize(_out_frame_size);
-                _native_fourcc = libyuv::FOURCC_I420;
-                out_frame_fmt_v4l = V4L2_PIX_FMT_YUV420;
-                break;
-            case libyuv::FOURCC_J400:
-                _out_frame_size = gray_frame_size(width, height);
-                _native_fourcc = _frame_fourcc;
-                out_frame_fmt_v4l = V4L2_PIX_FMT_GREY;
-                break;
-            case libyuv::FOURCC_I420:
-                _out_frame_size = i420_frame_size(width, height);
-                _native_fourcc = _frame_fourcc;
-                out_frame_fmt_v4l = V4L2_PIX_FMT_YUV420;
+                native_fourccs.push_back(libyuv::FOURCC_I420);
                 break;
-            case libyuv::FOURCC_NV12:
-                _out_frame_size = nv12_frame_size(width, height);
-                _native_fourcc = _frame_fourcc;
-                out_frame_fmt_v4l = V4L2_PIX_FMT_NV12;
-                break;
-            case libyuv::FOURCC_YUY2:
-                _out_frame_size = yuyv_frame_size(width, height);
-                _native_fourcc = _frame_fourcc;
-                out_frame_fmt_v4l = V4L2_PIX_FMT_YUYV;
-                break;
-            case libyuv::FOURCC_UYVY:
-                _out_frame_size = uyvy_frame_size(width, height);
-                _native_fourcc = _frame_fourcc;
-                out_frame_fmt_v4l = V4L2_PIX_FMT_UYVY;
+            case libyuv::FOURCC_ABGR:
+                // There is no conversion to a YUV format without dropping alpha.
+                if (!passthrough) {
+                    throw std::runtime_error("Unsupported image format.");
+                }
+                native_fourccs.push_back(_frame_fourcc);
                 break;
             default:
+                if (!v4l2_pixel_format(_frame_fourcc)) {
+                    throw std::runtime_error("Unsupported image format.");
+                }
+                native_fourccs.push_back(_frame_fourcc);
+                break;
+        }
+
+        // Chosen by the caller instead, like MultiOutput does for each of its outputs.
+        if (native_fourcc) {
+            native_fourcc = libyuv::CanonicalFourCC(native_fourcc);
+            if (!v4l2_pixel_format(native_fourcc)) {
                 throw std::runtime_error("Unsupported image format.");
+            }
+            // Throws before the device is opened if frames cannot be converted to it.
+            ConversionPlan(_frame_fourcc, native_fourcc, width, height);
+            native_fourccs = { native_fourcc };
         }
 
+        // Held until the device is in ACTIVE_DEVICES,
+        // so that no other camera picks the same one meanwhile.
+        std::unique_lock<std::mutex> devices_lock(ACTIVE_DEVICES_MUTEX);
+
         auto try_open = [&](const std::string& device_name) {
             if (ACTIVE_DEVICES.count(device_name)) {
                 throw std::invalid_argument(
                     "Device " + device_name + " is already in use."
                 );
             }
-            _camera_fd = open(device_name.c_str(), O_WRONLY | O_SYNC);
+            // Mapping buffers for writing requires the device to be readable, too.
+            int access = buffers > 0 ? O_RDWR : O_WRONLY;
+            _camera_fd = open(device_name.c_str(), access | O_SYNC);
             if (_camera_fd == -1) {
                 if (errno == EACCES) {
                     throw std::runtime_error(
@@ -140,18 +491,36 @@ class VirtualOutput {
             device_name = device_.value();
             try_open(device_name);
         } else {
-            bool found = false;
-            for (size_t i = 0; i < 100; i++) {
-                std::ostringstream device_name_s;
-                device_name_s << "/dev/video" << i;
-                device_name = device_name_s.str();
-                try {
-                    try_open(device_name);
-                } catch (std::invalid_argument&) {
-                    continue;
+            auto try_candidates = [&](const std::vector<std::string>& candidates) {
+                for (const std::string& candidate : candidates) {
+                    if (ACTIVE_DEVICES.count(candidate)) {
+                        continue;
+                    }
+                    try {
+                        try_open(candidate);
+                    } catch (std::invalid_argument&) {
+                        continue;
+                    }
+                    device_name = candidate;
+                    return true;
+                }
+                return false;
+            };
+            // The devices of the last scan are tried first. If none of them is free,
+            // sysfs is scanned again, as devices may have been added since.
+            bool found = try_candidates(LOOPBACK_DEVICES);
+            if (!found) {
+                std::vector<LoopbackDevice> devices;
+                if (rescan_loopback_devices(devices)) {
+                    found = try_candidates(LOOPBACK_DEVICES);
+                } else {
+                    // Without sysfs, all device nodes are probed.
+                    std::vector<std::string> candidates;
+                    for (size_t i = 0; i < 100; i++) {
+                        candidates.push_back("/dev/video" + std::to_string(i));
+                    }
+                    found = try_candidates(candidates);
                 }
-                found = true;
-                break;
             }
             if (!found) {
                 throw std::runtime_error(
@@ -161,23 +530,75 @@ class VirtualOutput {
             }
         }
 
+        // v4l2loopback sets bytesperline, sizeimage, and colorspace for us.
+        // Older versions do not know all packed RGB formats,
+        // in which case the next native format is tried.
         v4l2_format v4l2_fmt;
-        memset(&v4l2_fmt, 0, sizeof(v4l2_fmt));
-        v4l2_fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
         v4l2_pix_format& pix = v4l2_fmt.fmt.pix;
-        pix.width = width;
-        pix.height = height;
-        pix.pixelformat = out_frame_fmt_v4l;
+        int error = 0;
+        _native_fourcc = 0;
 
-        // v4l2loopback sets bytesperline, sizeimage, and colorspace for us.
+        for (uint32_t native_fourcc : native_fourccs) {
+            memset(&v4l2_fmt, 0, sizeof(v4l2_fmt));
+            v4l2_fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+            pix.width = width;
+            pix.height = height;
+            pix.pixelformat = v4l2_pixel_format(native_fourcc);
+
+            if (ioctl(_camera_fd, VIDIOC_S_FMT, &v4l2_fmt) == -1) {
+                error = errno;
+            } else if (pix.pixelformat != v4l2_pixel_format(native_fourcc)) {
+                error = EINVAL;
+            } else {
+                _native_fourcc = native_fourcc;
+                break;
+            }
+        }
 
-        if (ioctl(_camera_fd, VIDIOC_S_FMT, &v4l2_fmt) == -1) {
+        if (!_native_fourcc) {
             close(_camera_fd);
             throw std::runtime_error(
                 "Virtual camera device " + device_name + 
-                " could not be configured: " + std::string(strerror(errno))
+                " could not be configured: " + std::string(strerror(error))
             );
         }
+
+        // Consumers may use the frame rate to negotiate theirs.
+        // Older versions of v4l2loopback ignore it, so failing is not an error.
+        v4l2_streamparm v4l2_parm;
+        memset(&v4l2_parm, 0, sizeof(v4l2_parm));
+        v4l2_parm.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        set_timeperframe(fps, v4l2_parm.parm.output.timeperframe);
+        ioctl(_camera_fd, VIDIOC_S_PARM, &v4l2_parm);
+
+        // With sustain_framerate, v4l2loopback repeats the last frame if we send slower than fps.
+        // With a timeout, it shows the timeout image if we send nothing for that long.
+        _sustain_framerate = sustain_framerate;
+        _timeout = timeout;
+        if ((sustain_framerate && !set_control(V4L2LOOPBACK_CID_SUSTAIN_FRAMERATE, 1)) ||
+            (timeout && !set_control(V4L2LOOPBACK_CID_TIMEOUT, timeout))) {
+            error = errno;
+            close(_camera_fd);
+            throw std::runtime_error(
+                "Virtual camera device " + device_name +
+                " could not be configured: " + std::string(strerror(error))
+            );
+        }
+
+        // Consumers opening or closing the device are signalled as events, pending events as POLLPRI.
+        // The initial event gives the number of consumers at the time of subscribing.
+        v4l2_event_subscription subscription;
+        memset(&subscription, 0, sizeof(subscription));
+        subscription.type = V4L2_EVENT_PRI_CLIENT_USAGE;
+        subscription.flags = V4L2_EVENT_SUB_FL_SEND_INITIAL;
+        _client_usage_events = ioctl(_camera_fd, VIDIOC_SUBSCRIBE_EVENT, &subscription) != -1;
+
+        _out_frame_size = frame_size(_native_fourcc, width, height);
+        _plan = ConversionPlan(_frame_fourcc, _native_fourcc, width, height);
+
+        if (buffers > 0) {
+            start_streaming(buffers, pix);
+        }
         
         _output_running = true;
         _camera_device = device_name;
@@ -185,41 +606,64 @@ class VirtualOutput {
         ACTIVE_DEVICES.insert(_camera_device);
     }
 
+    ~VirtualOutput() {
+        stop();
+    }
+
     void stop() {
         if (!_output_running) {
             return;
         }
 
-        close(_camera_fd);
+        if (!_mapped_buffers.empty()) {
+            stop_streaming();
+        }
+        {
+            // has_consumers() may be polling the device on another thread.
+            std::lock_guard<std::mutex> lock(_consumers_mutex);
+            close(_camera_fd);
+            _output_running = false;
+        }
         
-        _output_running = false;
+        std::lock_guard<std::mutex> lock(ACTIVE_DEVICES_MUTEX);
         ACTIVE_DEVICES.erase(_camera_device);
     }
 
-    void send(const uint8_t* frame) {
+    // `timestamp_ns` is the time the frame is due on the monotonic clock, 0 for now.
+    // It is passed on to consumers with streaming I/O only, as write() cannot carry it.
+    void send(const Planes& frame, int64_t timestamp_ns = 0) {
         if (!_output_running)
             return;
 
-        uint8_t* out_frame;
+        // A new frame replaces the held one, even if nobody would see it.
+        hold_frame(false);
+        if (!wants_frames()) {
+            // Nobody would see the frame, so it is neither converted nor written.
+            return;
+        }
+        _sent_frame = true;
+        // Held until the frame is sent, in case it is replaced meanwhile.
+        std::shared_ptr<const Overlay> overlay = _overlay.get();
 
-        switch (_frame_fourcc) {
-            case libyuv::FOURCC_RAW:
-                out_frame = _buffer_output.data();
-                rgb_to_i420(frame, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_24BG:
-                out_frame = _buffer_output.data();
-                bgr_to_i420(frame, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_J400:
-            case libyuv::FOURCC_I420:
-            case libyuv::FOURCC_NV12:
-            case libyuv::FOURCC_YUY2:
-            case libyuv::FOURCC_UYVY:
-                out_frame = const_cast<uint8_t*>(frame);
-                break;
-            default:
-                throw std::logic_error("not implemented");
+        if (!_mapped_buffers.empty()) {
+            send_streaming(frame, timestamp_ns, overlay.get());
+            return;
+        }
+
+        const uint8_t* out_frame;
+
+        if (!overlay && _plan.empty() && is_contiguous(_frame_fourcc, frame, _frame_width, _frame_height)) {
+            out_frame = frame.data[0];
+        } else {
+            // Converted, or copied if e.g. rows are padded or planes are separate arrays.
+            // A gathered write (writev) is not used as v4l2loopback
+            // would take each part as a separate frame.
+            Planes out_planes = output_planes();
+            _plan(frame, out_planes, _pool.get());
+            if (overlay) {
+                overlay->blend(out_planes);
+            }
+            out_frame = out_planes.data[0];
         }
 
         ssize_t n = write(_camera_fd, out_frame, _out_frame_size);
@@ -229,6 +673,101 @@ class VirtualOutput {
         }
     }
 
+    // Sets the image v4l2loopback shows once the timeout passed without a frame.
+    // v4l2loopback takes the next opener of the device after enabling timeout image I/O
+    // as the writer of the timeout image, which is written into its single mapped buffer.
+    void set_timeout_image(const Planes& image) {
+        if (!set_control(V4L2LOOPBACK_CID_TIMEOUT_IMAGE_IO, 1)) {
+            throw std::runtime_error(
+                "Timeout image could not be set: " + std::string(strerror(errno))
+            );
+        }
+        int fd = open(_camera_device.c_str(), O_RDWR);
+        bool done = false;
+        if (fd != -1) {
+            v4l2_requestbuffers request;
+            memset(&request, 0, sizeof(request));
+            request.count = 1;
+            request.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+            request.memory = V4L2_MEMORY_MMAP;
+            v4l2_buffer buffer;
+            memset(&buffer, 0, sizeof(buffer));
+            buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+            buffer.memory = V4L2_MEMORY_MMAP;
+            if (ioctl(fd, VIDIOC_REQBUFS, &request) != -1 &&
+                ioctl(fd, VIDIOC_QUERYBUF, &buffer) != -1 && buffer.length >= _out_frame_size) {
+                void* data = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                  fd, buffer.m.offset);
+                if (data != MAP_FAILED) {
+                    _plan(image, frame_planes(_native_fourcc, static_cast<uint8_t*>(data),
+                                              _frame_width, _frame_height), _pool.get());
+                    buffer.bytesused = _out_frame_size;
+                    done = ioctl(fd, VIDIOC_QBUF, &buffer) != -1;
+                    munmap(data, buffer.length);
+                }
+            }
+            close(fd);
+        }
+        if (!done) {
+            int error = errno;
+            set_control(V4L2LOOPBACK_CID_TIMEOUT_IMAGE_IO, 0);
+            throw std::runtime_error(
+                "Timeout image could not be set: " + std::string(strerror(error))
+            );
+        }
+    }
+
+    // While a frame is held, v4l2loopback repeats it at the frame rate
+    // and never shows the timeout image, so that it need not be sent again.
+    // Releasing it, which the next send() does, restores the sustain_framerate
+    // and timeout settings. Returns false if v4l2loopback does not support this.
+    bool hold_frame(bool hold) {
+        std::lock_guard<std::mutex> lock(_hold_mutex);
+        if (hold) {
+            _held = set_control(V4L2LOOPBACK_CID_SUSTAIN_FRAMERATE, 1) &&
+                    set_control(V4L2LOOPBACK_CID_TIMEOUT, 0);
+            return _held;
+        }
+        if (!_held) {
+            return true;
+        }
+        _held = false;
+        return set_control(V4L2LOOPBACK_CID_SUSTAIN_FRAMERATE, _sustain_framerate) &&
+               set_control(V4L2LOOPBACK_CID_TIMEOUT, _timeout);
+    }
+
+    // Whether a consumer is reading from the device, or nothing if v4l2loopback
+    // is too old to tell. Costs a single poll() if the number of consumers did not change.
+    std::optional<bool> has_consumers() {
+        if (!_client_usage_events) {
+            return std::nullopt;
+        }
+        std::lock_guard<std::mutex> lock(_consumers_mutex);
+        if (!_output_running) {
+            return _consumers > 0;
+        }
+        pollfd fd = { _camera_fd, POLLPRI, 0 };
+        while (poll(&fd, 1, 0) == 1 && (fd.revents & POLLPRI)) {
+            v4l2_event event;
+            memset(&event, 0, sizeof(event));
+            if (ioctl(_camera_fd, VIDIOC_DQEVENT, &event) == -1) {
+                break;
+            }
+            if (event.type == V4L2_EVENT_PRI_CLIENT_USAGE) {
+                v4l2_event_client_usage usage;
+                memcpy(&usage, &event.u, sizeof(usage));
+                _consumers = usage.count;
+            }
+        }
+        return _consumers > 0;
+    }
+
+    // Whether the next frame should be sent, which is the case
+    // unless it is known that nobody is reading.
+    bool wants_frames() {
+        return !_sent_frame || has_consumers().value_or(true);
+    }
+
     std::string device() {
         return _camera_device;
     }
@@ -236,4 +775,23 @@ class VirtualOutput {
     uint32_t native_fourcc() {
         return _native_fourcc;
     }
+
+    const ConversionPlan& conversion_plan() {
+        return _plan;
+    }
+
+    // The threads that frames are converted on, for other work on frames before sending them.
+    ThreadPool* thread_pool() {
+        return _pool.get();
+    }
+
+    // Blends an image into each frame from now on, or no longer if nullptr.
+    void set_overlay(std::shared_ptr<const Overlay> overlay) {
+        _overlay.set(std::move(overlay));
+    }
+
+    // Number of buffers used for streaming I/O, or 0 if frames are written with write().
+    uint32_t buffer_count() {
+        return uint32_t(_mapped_buffers.size());
+    }
 };
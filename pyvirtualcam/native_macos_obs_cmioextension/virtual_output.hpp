@@ -26,10 +26,12 @@
 
 #include <stdexcept>
 #include <cstdint>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
-#include "../native_shared/image_formats.h"
+#include "../native_shared/conversion_graph.h"
+#include "../native_shared/overlay.h"
 
 
 // This is pulled out of OBS. We can probably assume that if this changes, the camera will be incompatible anyways.
@@ -46,16 +48,18 @@ class VirtualOutput {
     CMIOStreamID streamID{0};
     CMSimpleQueueRef queue;
     CMFormatDescriptionRef formatDescription;
+    bool running = false;
 
     uint32_t frameWidth;
     uint32_t frameHeight;
     uint32_t frameFourCC;
-    uint32_t frameSize;
-    std::vector<uint8_t> bufferTmp;
-    std::vector<uint8_t> bufferOutput;
+    ConversionPlan plan;
+    OverlaySlot overlay;
+    std::unique_ptr<ThreadPool> pool;
 
   public:
-    VirtualOutput(uint32_t width, uint32_t height, uint32_t fourcc, std::optional<std::string> device_) : lock(mutex, std::try_to_lock) {
+    VirtualOutput(uint32_t width, uint32_t height, uint32_t fourcc, std::optional<std::string> device_,
+                  uint32_t threads, const std::vector<uint32_t>& cpuAffinity) : lock(mutex, std::try_to_lock) {
         if (device_.has_value() && device_ != device()) {
             throw std::invalid_argument(
                 "This backend supports only the '" + device() + "' device."
@@ -69,36 +73,10 @@ class VirtualOutput {
         frameFourCC = libyuv::CanonicalFourCC(fourcc);
         frameWidth = width;
         frameHeight = height;
+        pool = std::make_unique<ThreadPool>(threads, cpuAffinity);
 
-        frameSize = uyvy_frame_size(width, height);
-
-        switch (frameFourCC) {
-            case libyuv::FOURCC_RAW:
-            case libyuv::FOURCC_24BG:
-            case libyuv::FOURCC_J400:
-                // RGB|BGR|GRAY -> BGRA -> UYVY
-                bufferTmp.resize(bgra_frame_size(width, height));
-                bufferOutput.resize(frameSize);
-                break;
-            case libyuv::FOURCC_I420:
-                // I420 -> UYVY
-                bufferOutput.resize(frameSize);
-                break;
-            case libyuv::FOURCC_NV12:
-                // NV12 -> I420 -> UYVY
-                bufferTmp.resize(i420_frame_size(width, height));
-                bufferOutput.resize(frameSize);
-                break;
-            case libyuv::FOURCC_YUY2:
-                // YUYV -> I422 -> UYVY
-                bufferTmp.resize(i422_frame_size(width, height));
-                bufferOutput.resize(frameSize);
-                break;
-            case libyuv::FOURCC_UYVY:
-                break;
-            default:
-                throw std::runtime_error("Unsupported image format.");
-        }
+        // RGB|BGR|GRAY|I420|NV12|I422|YUYV -> UYVY, along the cheapest path
+        plan = ConversionPlan(frameFourCC, libyuv::FOURCC_UYVY, width, height);
 
         FourCharCode videoFormat = kCVPixelFormatType_422YpCbCr8; // UYVY
 
@@ -167,59 +145,29 @@ class VirtualOutput {
         if (result != noErr) {
             throw std::runtime_error("Couldn't start stream");
         }
+        running = true;
+    }
+
+    ~VirtualOutput() {
+        stop();
     }
 
     void stop() {
+        if (!running) {
+            return;
+        }
+        running = false;
         CMIODeviceStopStream(deviceID, streamID);
         CFRelease(formatDescription);
         CVPixelBufferPoolRelease(pixelBufferPool);
     }
 
-    void send(const uint8_t* frame) {
+    // Frames are stamped when they are sent, so `timestamp_ns` is ignored.
+    void send(const Planes& frame, int64_t timestamp_ns = 0) {
         if (streamID == 0) {
             throw std::runtime_error("Stream does not exist.");
         }
 
-        uint8_t* tmp = bufferTmp.data();
-        uint8_t* outFrame;
-
-        switch (frameFourCC) {
-            case libyuv::FOURCC_RAW:
-                outFrame = bufferOutput.data();
-                rgb_to_bgra(frame, tmp, frameWidth, frameHeight);
-                bgra_to_uyvy(tmp, outFrame, frameWidth, frameHeight);
-                break;
-            case libyuv::FOURCC_24BG:
-                outFrame = bufferOutput.data();
-                bgr_to_bgra(frame, tmp, frameWidth, frameHeight);
-                bgra_to_uyvy(tmp, outFrame, frameWidth, frameHeight);
-                break;
-            case libyuv::FOURCC_J400:
-                outFrame = bufferOutput.data();
-                gray_to_bgra(frame, tmp, frameWidth, frameHeight);
-                bgra_to_uyvy(tmp, outFrame, frameWidth, frameHeight);
-                break;
-            case libyuv::FOURCC_I420:
-                outFrame = bufferOutput.data();
-                i420_to_uyvy(frame, outFrame, frameWidth, frameHeight);
-                break;
-            case libyuv::FOURCC_NV12:
-                outFrame = bufferOutput.data();
-                nv12_to_i420(frame, tmp, frameWidth, frameHeight);
-                i420_to_uyvy(tmp, outFrame, frameWidth, frameHeight);
-                break;
-            case libyuv::FOURCC_YUY2:
-                outFrame = bufferOutput.data();
-                yuyv_to_i422(frame, tmp, frameWidth, frameHeight);
-                i422_to_uyvy(tmp, outFrame, frameWidth, frameHeight);
-                break;
-            case libyuv::FOURCC_UYVY:
-                outFrame = const_cast<uint8_t*>(frame);
-                break;
-            default:
-                throw std::logic_error("not implemented");
-        }
-
         CVPixelBufferRef frameRef;
         CVReturn status = CVPixelBufferPoolCreatePixelBuffer(
             kCFAllocatorDefault, pixelBufferPool, &frameRef);
@@ -233,13 +181,14 @@ class VirtualOutput {
 
         CVPixelBufferLockBaseAddress(frameRef, 0);
 
-        uint8_t *dst = (uint8_t *)CVPixelBufferGetBaseAddress(frameRef);
-        int dst_size = CVPixelBufferGetDataSize(frameRef);
+        // Convert directly into the pixel buffer, whose rows may be padded.
+        Planes outFrame;
+        outFrame.data[0] = (uint8_t *)CVPixelBufferGetBaseAddress(frameRef);
+        outFrame.stride[0] = (int32_t)CVPixelBufferGetBytesPerRow(frameRef);
 
-        if (dst_size == frameSize) {
-			memcpy(dst, outFrame, frameSize);
-        } else {
-            fprintf(stderr, "Pixel buffer size mismatch");
+        plan(frame, outFrame, pool.get());
+        if (std::shared_ptr<const Overlay> current = overlay.get()) {
+            current->blend(outFrame);
         }
 
         CVPixelBufferUnlockBaseAddress(frameRef, 0);
@@ -254,6 +203,11 @@ class VirtualOutput {
         CVPixelBufferRelease(frameRef);
     }
 
+    // OBS does not tell whether anybody reads, so all frames are sent.
+    bool wants_frames() {
+        return true;
+    }
+
     std::string device()
     {
         // https://github.com/obsproject/obs-studio/blob/7778070cbd8e4689d91d90068091ced467c5fdef/plugins/mac-virtualcam/src/camera-extension/OBSCameraProviderSource.swift#L22
@@ -263,6 +217,20 @@ class VirtualOutput {
     uint32_t native_fourcc() {
         return libyuv::FOURCC_UYVY;
     }
+
+    const ConversionPlan& conversion_plan() {
+        return plan;
+    }
+
+    // The threads that frames are converted on, for other work on frames before sending them.
+    ThreadPool* thread_pool() {
+        return pool.get();
+    }
+
+    // Blends an image into each frame from now on, or no longer if nullptr.
+    void set_overlay(std::shared_ptr<const Overlay> overlay) {
+        overlay.set(std::move(overlay));
+    }
 };
 
 std::mutex VirtualOutput::mutex;
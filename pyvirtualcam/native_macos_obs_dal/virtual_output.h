@@ -24,9 +24,11 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <memory>
 #include <mach/mach_time.h>
 #include "server/OBSDALMachServer.h"
-#include "../native_shared/image_formats.h"
+#include "../native_shared/conversion_graph.h"
+#include "../native_shared/overlay.h"
 
 class VirtualOutput {
   private:
@@ -37,11 +39,11 @@ class VirtualOutput {
     uint32_t _frame_width;
     uint32_t _frame_height;
     uint32_t _frame_fourcc;
-    uint32_t _out_frame_size;
     uint32_t _fps_num;
     uint32_t _fps_den;
-    std::vector<uint8_t> _buffer_tmp;
-    std::vector<uint8_t> _buffer_output;
+    ConversionPlan _plan;
+    OverlaySlot _overlay;
+    std::unique_ptr<ThreadPool> _pool;
 
     // https://stackoverflow.com/a/23378064
     uint64_t scale_mach_time(uint64_t i) {
@@ -56,7 +58,8 @@ class VirtualOutput {
 
   public:
     VirtualOutput(uint32_t width, uint32_t height, double fps, uint32_t fourcc,
-                  std::optional<std::string> device_) {
+                  std::optional<std::string> device_,
+                  uint32_t threads, const std::vector<uint32_t>& cpu_affinity) {
         NSString *dal_plugin_path = @"/Library/CoreMediaIO/Plug-Ins/DAL/obs-mac-virtualcam.plugin";
         NSFileManager *file_manager = [NSFileManager defaultManager];
         BOOL dal_plugin_installed = [file_manager fileExistsAtPath:dal_plugin_path];
@@ -92,36 +95,10 @@ class VirtualOutput {
         _frame_height = height;
         _fps_num = fps * 1000;
         _fps_den = 1000;
+        _pool = std::make_unique<ThreadPool>(threads, cpu_affinity);
 
-        _out_frame_size = uyvy_frame_size(width, height);
-
-        switch (_frame_fourcc) {
-            case libyuv::FOURCC_RAW:
-            case libyuv::FOURCC_24BG:
-            case libyuv::FOURCC_J400:
-                // RGB|BGR|GRAY -> BGRA -> UYVY
-                _buffer_tmp.resize(bgra_frame_size(width, height));
-                _buffer_output.resize(_out_frame_size);
-                break;
-            case libyuv::FOURCC_I420:
-                // I420 -> UYVY
-                _buffer_output.resize(_out_frame_size);
-                break;
-            case libyuv::FOURCC_NV12:
-                // NV12 -> I420 -> UYVY
-                _buffer_tmp.resize(i420_frame_size(width, height));
-                _buffer_output.resize(_out_frame_size);
-                break;
-            case libyuv::FOURCC_YUY2:
-                // YUYV -> I422 -> UYVY
-                _buffer_tmp.resize(i422_frame_size(width, height));
-                _buffer_output.resize(_out_frame_size);
-                break;
-            case libyuv::FOURCC_UYVY:
-                break;
-            default:
-                throw std::runtime_error("Unsupported image format.");
-        }
+        // RGB|BGR|GRAY|I420|NV12|I422|YUYV -> UYVY, along the cheapest path
+        _plan = ConversionPlan(_frame_fourcc, libyuv::FOURCC_UYVY, width, height);
 
         _cv_format = kCVPixelFormatType_422YpCbCr8; // UYVY
 
@@ -149,6 +126,10 @@ class VirtualOutput {
         assert(mti_status == KERN_SUCCESS);
     }
 
+    ~VirtualOutput() {
+        stop();
+    }
+
     void stop() {
         if (_mach_server == nil) {
             return;
@@ -167,7 +148,8 @@ class VirtualOutput {
         [NSThread sleepForTimeInterval:0.2f];
     }
 
-    void send(const uint8_t* frame) {
+    // Frames are stamped when they are sent, so `timestamp_ns` is ignored.
+    void send(const Planes& frame, int64_t timestamp_ns = 0) {
         if (_mach_server == nil) {
             return;
         }
@@ -180,46 +162,6 @@ class VirtualOutput {
         
         uint64_t timestamp = scale_mach_time(mach_absolute_time());
 
-        uint8_t* tmp = _buffer_tmp.data();
-        uint8_t* out_frame;
-        
-        switch (_frame_fourcc) {
-            case libyuv::FOURCC_RAW:            
-                out_frame = _buffer_output.data();
-                rgb_to_bgra(frame, tmp, _frame_width, _frame_height);
-                bgra_to_uyvy(tmp, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_24BG:
-                out_frame = _buffer_output.data();
-                bgr_to_bgra(frame, tmp, _frame_width, _frame_height);
-                bgra_to_uyvy(tmp, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_J400:
-                out_frame = _buffer_output.data();
-                gray_to_bgra(frame, tmp, _frame_width, _frame_height);
-                bgra_to_uyvy(tmp, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_I420:
-                out_frame = _buffer_output.data();
-                i420_to_uyvy(frame, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_NV12:
-                out_frame = _buffer_output.data();
-                nv12_to_i420(frame, tmp, _frame_width, _frame_height);
-                i420_to_uyvy(tmp, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_YUY2:
-                out_frame = _buffer_output.data();
-                yuyv_to_i422(frame, tmp, _frame_width, _frame_height);
-                i422_to_uyvy(tmp, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_UYVY:
-                out_frame = const_cast<uint8_t*>(frame);
-                break;
-            default:
-                throw std::logic_error("not implemented");
-        }
-        
         CVPixelBufferRef frame_ref = nil;
         CVReturn status = CVPixelBufferPoolCreatePixelBuffer(
             kCFAllocatorDefault, _cv_pool, &frame_ref);
@@ -233,13 +175,14 @@ class VirtualOutput {
 
         CVPixelBufferLockBaseAddress(frame_ref, 0);
 
-        uint8_t *dst = (uint8_t *)CVPixelBufferGetBaseAddress(frame_ref);
-        int dst_size = CVPixelBufferGetDataSize(frame_ref);
+        // Convert directly into the pixel buffer, whose rows may be padded.
+        Planes out;
+        out.data[0] = (uint8_t *)CVPixelBufferGetBaseAddress(frame_ref);
+        out.stride[0] = (int32_t)CVPixelBufferGetBytesPerRow(frame_ref);
 
-        if (dst_size == _out_frame_size) {
-			memcpy(dst, out_frame, _out_frame_size);
-        } else {
-            fprintf(stderr, "pixel buffer size mismatch");
+        _plan(frame, out, _pool.get());
+        if (std::shared_ptr<const Overlay> overlay = _overlay.get()) {
+            overlay->blend(out);
         }
 
         CVPixelBufferUnlockBaseAddress(frame_ref, 0);
@@ -252,6 +195,11 @@ class VirtualOutput {
         CVPixelBufferRelease(frame_ref);
     }
 
+    // OBS does not tell whether anybody reads, so all frames are sent.
+    bool wants_frames() {
+        return true;
+    }
+
     std::string device()
     {
         // https://github.com/obsproject/obs-studio/blob/eb98505a2/plugins/mac-virtualcam/src/dal-plugin/OBSDALDevice.mm#L106
@@ -261,4 +209,18 @@ class VirtualOutput {
     uint32_t native_fourcc() {
         return libyuv::FOURCC_UYVY;
     }
+
+    const ConversionPlan& conversion_plan() {
+        return _plan;
+    }
+
+    // The threads that frames are converted on, for other work on frames before sending them.
+    ThreadPool* thread_pool() {
+        return _pool.get();
+    }
+
+    // Blends an image into each frame from now on, or no longer if nullptr.
+    void set_overlay(std::shared_ptr<const Overlay> overlay) {
+        _overlay.set(std::move(overlay));
+    }
 };
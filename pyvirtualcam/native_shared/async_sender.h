@@ -0,0 +1,183 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "image_formats.h"
+
+// What to do with a frame when the queue is full.
+enum class DropPolicy {
+    // Replace the oldest queued frame, so that the newest frames are shown.
+    DROP_OLDEST,
+    // Drop the frame being sent, so that queued frames are shown in full.
+    DROP_NEWEST,
+    // Wait until a frame has been sent.
+    BLOCK,
+};
+
+static DropPolicy parse_drop_policy(const std::string& name) {
+    if (name == "drop_oldest") {
+        return DropPolicy::DROP_OLDEST;
+    } else if (name == "drop_newest") {
+        return DropPolicy::DROP_NEWEST;
+    } else if (name == "block") {
+        return DropPolicy::BLOCK;
+    }
+    throw std::invalid_argument(
+        "Unknown drop policy '" + name + "', expected 'drop_oldest', 'drop_newest' or 'block'."
+    );
+}
+
+// Sends frames to a backend on a thread of its own, so that push() returns
+// once a frame has been copied, without waiting for its conversion or for a slow consumer.
+// Frames are copied into slots allocated up front: one per queued frame
+// plus the one being sent. The lock is only held to pass slot indices around,
+// never while copying or sending a frame.
+class AsyncSender {
+  private:
+    const FormatInfo& _format;
+    int32_t _width;
+    int32_t _height;
+    size_t _depth;
+    DropPolicy _policy;
+    std::function<void(const Planes&)> _send;
+    std::vector<std::vector<uint8_t>> _slots;
+    std::mutex _mutex;
+    std::condition_variable _queued;
+    std::condition_variable _sent;
+    std::vector<size_t> _free_slots;
+    std::deque<size_t> _queue;
+    uint64_t _dropped = 0;
+    bool _stopping = false;
+    // Thrown by the backend on the sender thread, rethrown by the next push().
+    std::exception_ptr _error;
+    std::thread _thread;
+
+    void work() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _queued.wait(lock, [&] { return _stopping || !_queue.empty(); });
+            // Queued frames are still sent when stopping.
+            if (_queue.empty()) {
+                return;
+            }
+            size_t slot = _queue.front();
+            _queue.pop_front();
+            lock.unlock();
+            try {
+                _send(frame_planes(_format.fourcc, _slots[slot].data(), _width, _height));
+            } catch (...) {
+                lock.lock();
+                _error = std::current_exception();
+                lock.unlock();
+            }
+            lock.lock();
+            _free_slots.push_back(slot);
+            _sent.notify_all();
+        }
+    }
+
+  public:
+    AsyncSender(uint32_t fourcc, int32_t width, int32_t height, size_t depth, DropPolicy policy,
+                std::function<void(const Planes&)> send)
+        : _format(format_info(fourcc)), _width(width), _height(height),
+          _depth(depth), _policy(policy), _send(std::move(send)) {
+        if (depth == 0) {
+            throw std::invalid_argument("The queue depth must be at least 1.");
+        }
+        _slots.resize(depth + 1);
+        for (size_t i = 0; i < _slots.size(); i++) {
+            _slots[i].resize(frame_size(fourcc, width, height));
+            _free_slots.push_back(i);
+        }
+        _thread = std::thread(&AsyncSender::work, this);
+    }
+
+    ~AsyncSender() {
+        stop();
+    }
+
+    AsyncSender(const AsyncSender&) = delete;
+    AsyncSender& operator=(const AsyncSender&) = delete;
+
+    // Sends the frames that are still queued and stops the thread.
+    // Frames pushed afterwards are ignored.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _queued.notify_one();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    // Copies the frame and queues it, applying the drop policy if the queue is full.
+    // Must not be called from several threads at once.
+    void push(const Planes& frame) {
+        size_t slot;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_stopping) {
+                return;
+            }
+            if (_error) {
+                std::exception_ptr error = _error;
+                _error = nullptr;
+                std::rethrow_exception(error);
+            }
+            if (_queue.size() == _depth) {
+                switch (_policy) {
+                    case DropPolicy::DROP_OLDEST:
+                        _free_slots.push_back(_queue.front());
+                        _queue.pop_front();
+                        _dropped++;
+                        break;
+                    case DropPolicy::DROP_NEWEST:
+                        _dropped++;
+                        return;
+                    case DropPolicy::BLOCK:
+                        _sent.wait(lock, [&] { return _queue.size() < _depth; });
+                        break;
+                }
+            }
+            // With a queue of less than depth frames and at most one being sent,
+            // at least one of the depth + 1 slots is free.
+            slot = _free_slots.back();
+            _free_slots.pop_back();
+        }
+        Planes planes = frame_planes(_format.fourcc, _slots[slot].data(), _width, _height);
+        copy_planes(_format, frame, planes, _width, _height);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queue.push_back(slot);
+        }
+        _queued.notify_one();
+    }
+
+    // Waits until the frames pushed so far have been sent.
+    void drain() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _sent.wait(lock, [&] { return _free_slots.size() == _slots.size(); });
+    }
+
+    // Number of frames waiting to be sent.
+    size_t queued() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _queue.size();
+    }
+
+    // Number of frames dropped as the queue was full.
+    uint64_t dropped() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _dropped;
+    }
+};
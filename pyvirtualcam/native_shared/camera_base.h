@@ -0,0 +1,291 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+#include "numpy_frame.h"
+#include "async_sender.h"
+#include "frame_batch.h"
+#include "jitter_buffer.h"
+#include "frame_scaler.h"
+#include "frame_transform.h"
+#include "overlay.h"
+#include "compositor.h"
+
+static double positive_fps(double fps) {
+    if (!(fps > 0)) {
+        throw std::invalid_argument("fps must be positive");
+    }
+    return fps;
+}
+
+// What the Camera of each backend shares: preparing frames as passed by camera.py,
+// and sending them now, on a sender thread, or when they are due.
+//
+// `Output` is the VirtualOutput of a backend, constructed from the arguments that
+// follow the common ones. It stops itself when destroyed, so that nothing is left open
+// if constructing the camera fails after it, and provides stop(), send(frame, timestamp_ns = 0),
+// wants_frames(), device(), native_fourcc(), conversion_plan(), thread_pool()
+// and set_overlay(). A timestamp of 0 means now.
+template <typename Output>
+class CameraBase {
+  protected:
+    // Checked before the device is opened, as frames are paced and buffered by it.
+    double fps;
+    // Parsed before the device is opened, so that an unknown policy does not leave it open.
+    DropPolicy drop_policy;
+    // Scales frames sent in another size than that of the camera, if an input size is given.
+    // Created before the device is opened, like drop_policy.
+    std::unique_ptr<FrameScaler> scaler;
+    // Mirrors and rotates frames, if requested, after scaling them.
+    std::unique_ptr<FrameTransform> transform;
+    // Composes frames sent with compose(), created by the first call.
+    std::unique_ptr<Compositor> compositor;
+    Output virtual_output;
+    uint32_t frame_fourcc;
+    int32_t frame_width;
+    int32_t frame_height;
+    // Size of the frames passed to send().
+    int32_t input_width;
+    int32_t input_height;
+    // Sends frames on a thread of its own, if a queue depth is given.
+    // Declared after the device, so that it is stopped before it.
+    std::unique_ptr<AsyncSender> sender;
+    // Serializes sending and closing, which run without the GIL.
+    std::mutex send_mutex;
+    // Sends frames with a PTS when they are due, if a jitter buffer size is given.
+    // Declared after send_mutex, which its thread locks, so that it is stopped first.
+    std::unique_ptr<JitterBuffer> jitter_buffer;
+
+  public:
+    template <typename... OutputArgs>
+    CameraBase(uint32_t width, uint32_t height, double fps, uint32_t fourcc,
+               size_t queue_depth, const std::string& drop_policy_,
+               size_t jitter_buffer_,
+               std::optional<std::tuple<uint32_t, uint32_t>> input_size,
+               const std::string& fit, const std::string& filter,
+               bool mirror, uint32_t rotate,
+               OutputArgs&&... output_args)
+     : fps {positive_fps(fps)},
+       drop_policy {parse_drop_policy(drop_policy_)},
+       scaler {make_frame_scaler(fourcc, unrotated_size(width, height, rotate), input_size, fit, filter)},
+       transform {make_frame_transform(fourcc, width, height, mirror, rotate)},
+       virtual_output {std::forward<OutputArgs>(output_args)...},
+       frame_fourcc {libyuv::CanonicalFourCC(fourcc)}, frame_width {int32_t(width)}, frame_height {int32_t(height)},
+       input_width {int32_t(std::get<0>(input_size.value_or(unrotated_size(width, height, rotate))))},
+       input_height {int32_t(std::get<1>(input_size.value_or(unrotated_size(width, height, rotate))))} {
+        if (queue_depth > 0) {
+            sender = std::make_unique<AsyncSender>(
+                frame_fourcc, frame_width, frame_height, queue_depth, drop_policy,
+                [this](const Planes& frame) { virtual_output.send(frame); });
+        }
+        if (jitter_buffer_ > 0) {
+            if (sender) {
+                throw std::invalid_argument("queue_depth and jitter_buffer cannot be combined.");
+            }
+            jitter_buffer = std::make_unique<JitterBuffer>(
+                frame_fourcc, frame_width, frame_height, jitter_buffer_, fps,
+                [this](const Planes& frame, int64_t due_ns) {
+                    // Serialized with sending frames without PTS.
+                    std::lock_guard<std::mutex> lock(send_mutex);
+                    virtual_output.send(frame, due_ns);
+                });
+        }
+    }
+
+    void close() {
+        pybind11::gil_scoped_release release;
+        if (jitter_buffer) {
+            // Stopped before locking send_mutex, which its thread may be waiting for.
+            jitter_buffer->stop();
+        }
+        std::lock_guard<std::mutex> lock(send_mutex);
+        if (sender) {
+            // Sends the frames that are still queued.
+            sender->stop();
+        }
+        virtual_output.stop();
+    }
+
+    std::string device() {
+        return virtual_output.device();
+    }
+
+    uint32_t native_fourcc() {
+        return virtual_output.native_fourcc();
+    }
+
+    std::vector<std::string> conversion_path() {
+        return virtual_output.conversion_plan().path();
+    }
+
+    double conversion_cost() {
+        return virtual_output.conversion_plan().cost();
+    }
+
+    size_t queued_frames() {
+        return sender ? sender->queued() : 0;
+    }
+
+    uint64_t dropped_frames() {
+        return (sender ? sender->dropped() : 0) + (jitter_buffer ? jitter_buffer->dropped() : 0);
+    }
+
+    // Estimated arrival jitter of frames with PTS in milliseconds.
+    std::optional<double> arrival_jitter() {
+        if (!jitter_buffer) {
+            return std::nullopt;
+        }
+        return jitter_buffer->jitter_ns() / 1e6;
+    }
+
+    // Time in milliseconds by which the jitter buffer holds frames beyond the earliest arrival.
+    std::optional<double> playout_delay() {
+        if (!jitter_buffer) {
+            return std::nullopt;
+        }
+        return jitter_buffer->delay_ns() / 1e6;
+    }
+
+    // Blends an RGBA image of shape (h, w, 4) into each frame from now on,
+    // with its top left corner at (x, y), or no image if none is given.
+    void set_overlay(std::optional<pybind11::array_t<uint8_t>> image, int32_t x, int32_t y) {
+        std::shared_ptr<const Overlay> overlay;
+        if (image) {
+            if (image->ndim() != 3) {
+                throw std::invalid_argument("unexpected overlay shape, expected (h, w, 4)");
+            }
+            int32_t width = int32_t(image->shape(1));
+            int32_t height = int32_t(image->shape(0));
+            Planes planes = numpy_frame_planes(*image, libyuv::FOURCC_ABGR, width, height);
+            pybind11::gil_scoped_release release;
+            overlay = std::make_shared<Overlay>(native_fourcc(), frame_width, frame_height, planes, width, height, x, y);
+        }
+        virtual_output.set_overlay(std::move(overlay));
+    }
+
+    // Call with send_mutex held. The prepared frame is valid until the next call.
+    const Planes& prepare(const Planes& frame) {
+        const Planes& scaled = scaler ? (*scaler)(frame) : frame;
+        return transform ? (*transform)(scaled) : scaled;
+    }
+
+    // Call with send_mutex held.
+    void send_locked(const Planes& frame) {
+        if (sender) {
+            // Not even copied if nobody would see it.
+            if (virtual_output.wants_frames()) {
+                sender->push(frame);
+            }
+        } else {
+            virtual_output.send(frame);
+        }
+    }
+
+    // Call with send_mutex held.
+    void send_timed(const Planes& frame, double pts) {
+        if (!jitter_buffer) {
+            throw std::invalid_argument("Sending frames with pts requires the jitter_buffer backend argument.");
+        }
+        jitter_buffer->push(frame, std::llround(pts * 1e9));
+    }
+
+    void send_frame(const Planes& frame, std::optional<double> pts = std::nullopt) {
+        // Other Python threads, like those sending to other cameras,
+        // may run while the frame is converted and sent, or queued.
+        pybind11::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(send_mutex);
+        if (pts) {
+            send_timed(prepare(frame), *pts);
+        } else {
+            send_locked(prepare(frame));
+        }
+    }
+
+    void send(pybind11::array_t<uint8_t> frame, std::optional<double> pts) {
+        send_frame(numpy_frame_planes(frame, frame_fourcc, input_width, input_height), pts);
+    }
+
+    void send_planes(std::vector<pybind11::array_t<uint8_t>> planes, std::optional<double> pts) {
+        send_frame(numpy_planes(planes, frame_fourcc, input_width, input_height), pts);
+    }
+
+    // Returns the number of frames sent and dropped, see send_batch().
+    std::tuple<size_t, size_t> send_many(
+            pybind11::array_t<uint8_t> frames,
+            std::optional<pybind11::array_t<double, pybind11::array::c_style | pybind11::array::forcecast>> timestamps,
+            bool pace) {
+        std::vector<Planes> batch = numpy_batch_planes(frames, frame_fourcc, input_width, input_height);
+        const double* times = nullptr;
+        if (timestamps) {
+            if (timestamps->ndim() != 1 || timestamps->shape(0) != frames.shape(0)) {
+                throw std::invalid_argument("expected one timestamp per frame");
+            }
+            times = timestamps->data();
+        }
+        // The whole batch is sent without the GIL, in order. send_mutex is locked for each frame
+        // instead of the batch, so that pacing does not keep other threads from sending.
+        pybind11::gil_scoped_release release;
+        auto [sent, dropped] = send_batch(batch, times, fps, pace, [this](const Planes& frame) {
+            std::lock_guard<std::mutex> lock(send_mutex);
+            send_locked(prepare(frame));
+        });
+        return { sent, dropped };
+    }
+
+    // Composes a frame of several layers and sends it, see Camera.compose() in camera.py.
+    // Layers are scaled and converted straight into their region of the frame,
+    // which is sent as it is, without the scaling and transform of send().
+    void compose(const std::vector<NumpyLayer>& layers, std::optional<double> pts) {
+        std::vector<CompositorLayer> specs;
+        std::vector<std::optional<Planes>> sources;
+        for (const auto& [arrays, fourcc, width, height, x, y, rect_width, rect_height] : layers) {
+            uint32_t source_fourcc = libyuv::CanonicalFourCC(fourcc);
+            specs.push_back({ source_fourcc, width, height, { x, y, rect_width, rect_height } });
+            sources.push_back(arrays ? std::optional<Planes>(numpy_source_planes(*arrays, source_fourcc, width, height))
+                                     : std::nullopt);
+        }
+        pybind11::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(send_mutex);
+        if (!compositor) {
+            compositor = std::make_unique<Compositor>(frame_fourcc, frame_width, frame_height);
+        }
+        const Planes& frame = compositor->compose(specs, sources, virtual_output.thread_pool());
+        if (pts) {
+            send_timed(frame, *pts);
+        } else {
+            send_locked(frame);
+        }
+    }
+};
+
+// Binds the methods a Camera inherits from CameraBase, see Backend in camera.py.
+template <typename Camera>
+static void def_camera_base(pybind11::class_<Camera>& camera) {
+    namespace py = pybind11;
+    camera
+        .def("close", &Camera::close)
+        .def("send", &Camera::send, py::arg("frame"), py::arg("pts") = py::none())
+        .def("send_planes", &Camera::send_planes, py::arg("planes"), py::arg("pts") = py::none())
+        .def("send_many", &Camera::send_many)
+        .def("set_overlay", &Camera::set_overlay, py::arg("image"), py::arg("x") = 0, py::arg("y") = 0)
+        .def("compose", &Camera::compose, py::arg("layers"), py::arg("pts") = py::none())
+        .def("device", &Camera::device)
+        .def("native_fourcc", &Camera::native_fourcc)
+        .def("conversion_path", &Camera::conversion_path)
+        .def("conversion_cost", &Camera::conversion_cost)
+        .def("queued_frames", &Camera::queued_frames)
+        .def("dropped_frames", &Camera::dropped_frames)
+        .def("arrival_jitter", &Camera::arrival_jitter)
+        .def("playout_delay", &Camera::playout_delay);
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "conversion_graph.h"
+#include "frame_scaler.h"
+
+// One source of a composed frame: its format and size, and the region it is scaled into.
+struct CompositorLayer {
+    uint32_t fourcc;
+    int32_t width;
+    int32_t height;
+    FrameRect rect;
+};
+
+static bool rects_overlap(const FrameRect& a, const FrameRect& b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width &&
+           a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+// Composes frames from several sources, like a picture-in-picture layout,
+// scaling and converting each source straight into its region of the frame.
+//
+// The frame is kept between calls, so that a source that did not change need not
+// be given again. Later layers are drawn over earlier ones. A layer overlapping
+// an earlier one is drawn into a copy of its own first, which is copied into the frame
+// whenever a layer below it is redrawn, so that it need not be converted again.
+// Layers are drawn in parallel on the threads of a pool.
+class Compositor {
+  private:
+    struct LayerState {
+        CompositorLayer layer;
+        // From the source format to the format of the frame, at the size of the region
+        // if the source is scaled first, or else at the size of the source.
+        ConversionPlan plan;
+        bool scaled = false;
+        bool scale_first = false;
+        // The source scaled in its own format, or converted at its own size,
+        // unless it is scaled straight into its region as it is in the format of the frame.
+        std::vector<uint8_t> temporary;
+        Planes temporary_planes;
+        // The drawn region of a layer overlapping an earlier one.
+        bool cached = false;
+        std::vector<uint8_t> cache;
+        Planes cache_planes;
+    };
+
+    const FormatInfo& _format;
+    int32_t _width;
+    int32_t _height;
+    std::vector<uint8_t> _buffer;
+    Planes _planes;
+    std::vector<LayerState> _layers;
+    // Per frame: layers drawn from a new source.
+    std::vector<size_t> _tasks;
+    std::vector<const Planes*> _sources;
+
+    LayerState make_state(const CompositorLayer& layer, size_t index) {
+        check_rect(_format, layer.rect, _width, _height, "Region of layer " + std::to_string(index));
+        if (layer.width <= 0 || layer.height <= 0) {
+            throw std::invalid_argument(
+                "Source of layer " + std::to_string(index) + " must have a positive width and height.");
+        }
+        const FormatInfo& source_format = format_info(layer.fourcc);
+        LayerState state;
+        state.layer = layer;
+        int32_t width = layer.rect.width;
+        int32_t height = layer.rect.height;
+        state.scaled = layer.width != width || layer.height != height;
+        if (state.scaled) {
+            // Scaling first converts fewer pixels if the source is scaled down.
+            bool downscaled = int64_t(layer.width) * layer.height > int64_t(width) * height;
+            state.scale_first = can_scale(source_format) && (downscaled || !can_scale(_format));
+            if (!state.scale_first && !can_scale(_format)) {
+                throw std::invalid_argument(
+                    std::string("Layer ") + std::to_string(index) + " cannot be scaled, as neither " +
+                    source_format.name + " nor " + _format.name + " frames can be scaled.");
+            }
+            if (!(state.scale_first && layer.fourcc == _format.fourcc)) {
+                uint32_t fourcc = state.scale_first ? layer.fourcc : _format.fourcc;
+                int32_t temporary_width = state.scale_first ? width : layer.width;
+                int32_t temporary_height = state.scale_first ? height : layer.height;
+                state.temporary.resize(frame_size(fourcc, temporary_width, temporary_height));
+                state.temporary_planes = frame_planes(fourcc, state.temporary.data(), temporary_width, temporary_height);
+            }
+        }
+        bool convert_at_region_size = !state.scaled || state.scale_first;
+        state.plan = ConversionPlan(layer.fourcc, _format.fourcc,
+                                    convert_at_region_size ? width : layer.width,
+                                    convert_at_region_size ? height : layer.height);
+        for (size_t i = 0; i < index; i++) {
+            state.cached = state.cached || rects_overlap(_layers[i].layer.rect, layer.rect);
+        }
+        if (state.cached) {
+            state.cache.resize(frame_size(_format.fourcc, width, height));
+            state.cache_planes = frame_planes(_format.fourcc, state.cache.data(), width, height);
+        }
+        return state;
+    }
+
+    void draw(LayerState& state, const Planes& source, ThreadPool* pool) {
+        const CompositorLayer& layer = state.layer;
+        Planes dst = state.cached ? state.cache_planes : rect_planes(_format, _planes, layer.rect);
+        if (!state.scaled) {
+            state.plan(source, dst, pool);
+        } else if (state.temporary.empty()) {
+            scale_planes(_format, source, layer.width, layer.height,
+                         dst, layer.rect.width, layer.rect.height, libyuv::kFilterBox);
+        } else if (state.scale_first) {
+            scale_planes(format_info(layer.fourcc), source, layer.width, layer.height,
+                         state.temporary_planes, layer.rect.width, layer.rect.height, libyuv::kFilterBox);
+            state.plan(state.temporary_planes, dst, pool);
+        } else {
+            state.plan(source, state.temporary_planes, pool);
+            scale_planes(_format, state.temporary_planes, layer.width, layer.height,
+                         dst, layer.rect.width, layer.rect.height, libyuv::kFilterBox);
+        }
+    }
+
+    void copy_cache(const LayerState& state) {
+        Planes dst = rect_planes(_format, _planes, state.layer.rect);
+        for (int i = 0; i < _format.plane_count; i++) {
+            libyuv::CopyPlane(
+                state.cache_planes.data[i], state.cache_planes.stride[i],
+                dst.data[i], dst.stride[i],
+                plane_row_size(_format, i, state.layer.rect.width),
+                state.layer.rect.height >> _format.planes[i].vshift);
+        }
+    }
+
+  public:
+    Compositor(uint32_t fourcc, int32_t width, int32_t height)
+        : _format(format_info(fourcc)), _width(width), _height(height) {
+        _buffer.resize(frame_size(fourcc, width, height));
+        _planes = frame_planes(fourcc, _buffer.data(), width, height);
+        fill_black(_format, _planes, width, height);
+    }
+
+    // Draws the layers with a source and returns the planes of the frame,
+    // which are valid until the next call. A layer without a source keeps
+    // its previous content, which requires its format and region to be unchanged.
+    // If the layers change otherwise, the frame is cleared and all of them need a source.
+    const Planes& compose(const std::vector<CompositorLayer>& layers,
+                          const std::vector<std::optional<Planes>>& sources, ThreadPool* pool) {
+        bool same_layout = layers.size() == _layers.size();
+        for (size_t i = 0; i < layers.size() && same_layout; i++) {
+            const CompositorLayer& old = _layers[i].layer;
+            const CompositorLayer& layer = layers[i];
+            same_layout = old.fourcc == layer.fourcc && old.rect.x == layer.rect.x &&
+                          old.rect.y == layer.rect.y && old.rect.width == layer.rect.width &&
+                          old.rect.height == layer.rect.height;
+        }
+        if (!same_layout) {
+            for (size_t i = 0; i < layers.size(); i++) {
+                if (!sources[i]) {
+                    throw std::invalid_argument(
+                        "Layer " + std::to_string(i) + " has no previous content to keep.");
+                }
+            }
+            _layers.clear();
+            for (size_t i = 0; i < layers.size(); i++) {
+                _layers.push_back(make_state(layers[i], i));
+            }
+            fill_black(_format, _planes, _width, _height);
+        } else {
+            // A layer whose source changed its size needs other temporaries.
+            for (size_t i = 0; i < layers.size(); i++) {
+                const CompositorLayer& old = _layers[i].layer;
+                if (sources[i] && (old.width != layers[i].width || old.height != layers[i].height)) {
+                    _layers[i] = make_state(layers[i], i);
+                }
+            }
+        }
+
+        _tasks.clear();
+        _sources.clear();
+        for (size_t i = 0; i < layers.size(); i++) {
+            _sources.push_back(sources[i] ? &*sources[i] : nullptr);
+            if (sources[i]) {
+                _tasks.push_back(i);
+            }
+        }
+        if (_tasks.size() == 1) {
+            // A single layer is converted in bands on the pool instead.
+            draw(_layers[_tasks[0]], *_sources[_tasks[0]], pool);
+        } else if (pool) {
+            pool->run(_tasks.size(), [this](size_t task) {
+                size_t i = _tasks[task];
+                draw(_layers[i], *_sources[i], nullptr);
+            });
+        } else {
+            for (size_t i : _tasks) {
+                draw(_layers[i], *_sources[i], nullptr);
+            }
+        }
+
+        // Layers overlapping earlier ones are copied over them in order,
+        // if they or anything below them changed.
+        std::vector<bool> changed(layers.size());
+        for (size_t i = 0; i < layers.size(); i++) {
+            changed[i] = sources[i].has_value();
+            if (!_layers[i].cached) {
+                continue;
+            }
+            for (size_t j = 0; j < i && !changed[i]; j++) {
+                changed[i] = changed[j] && rects_overlap(_layers[j].layer.rect, _layers[i].layer.rect);
+            }
+            if (changed[i]) {
+                copy_cache(_layers[i]);
+            }
+        }
+        return _planes;
+    }
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "image_formats.h"
+
+// The kernels of image_formats.h form a graph between formats.
+// A ConversionPlan is the cheapest path through this graph
+// between the format of the frames sent by the user and the native format
+// of a backend, so that backends don't have to pick kernels themselves.
+
+// Converts a whole frame like calling a Kernel, see convert_in_bands().
+using ConvertFrame = void (*)(const Planes& src, const Planes& dst,
+                              int32_t width, int32_t height, ThreadPool* pool);
+
+// Calling kernel K, specialized for its formats, so that the plane layouts
+// are constants and K.convert is called directly.
+template <const Kernel& K>
+static void convert_frame(const Planes& src, const Planes& dst,
+                          int32_t width, int32_t height, ThreadPool* pool) {
+    convert_in_bands(FORMAT<K.src_fourcc>, FORMAT<K.dst_fourcc>, K.convert,
+                     src, dst, width, height, pool);
+}
+
+// Copying a frame between two layouts of the same format, specialized like convert_frame().
+template <uint32_t FOURCC>
+static void copy_frame(const Planes& src, const Planes& dst,
+                       int32_t width, int32_t height, ThreadPool* pool) {
+    auto copy = [](const Planes& from, const Planes& to, int32_t width, int32_t height) {
+        copy_planes(FORMAT<FOURCC>, from, to, width, height);
+    };
+    convert_in_bands(FORMAT<FOURCC>, FORMAT<FOURCC>, copy, src, dst, width, height, pool);
+}
+
+static ConvertFrame copy_frame_of(uint32_t fourcc) {
+    switch (fourcc) {
+        case libyuv::FOURCC_J400: return copy_frame<libyuv::FOURCC_J400>;
+        case libyuv::FOURCC_RAW: return copy_frame<libyuv::FOURCC_RAW>;
+        case libyuv::FOURCC_24BG: return copy_frame<libyuv::FOURCC_24BG>;
+        case libyuv::FOURCC_ARGB: return copy_frame<libyuv::FOURCC_ARGB>;
+        case libyuv::FOURCC_ABGR: return copy_frame<libyuv::FOURCC_ABGR>;
+        case libyuv::FOURCC_I420: return copy_frame<libyuv::FOURCC_I420>;
+        case libyuv::FOURCC_NV12: return copy_frame<libyuv::FOURCC_NV12>;
+        case libyuv::FOURCC_I422: return copy_frame<libyuv::FOURCC_I422>;
+        case libyuv::FOURCC_YUY2: return copy_frame<libyuv::FOURCC_YUY2>;
+        case libyuv::FOURCC_UYVY: return copy_frame<libyuv::FOURCC_UYVY>;
+        default:
+            throw std::logic_error("not implemented");
+    }
+}
+
+// A kernel together with its estimated cost in nanoseconds per pixel.
+struct KernelCost {
+    const char* name;
+    const Kernel* kernel;
+    ConvertFrame convert_frame;
+    double ns_per_pixel;
+};
+
+#define KERNEL_COST(name, ns_per_pixel) { #name, &name, convert_frame<name>, ns_per_pixel }
+
+// Measured with test/image-formats/benchmark.py at 1920x1080 on one thread.
+// Only the relative costs matter for choosing a path.
+// Kernels converting a format to itself are not part of the graph,
+// a plan without any steps copies the frame instead.
+static const KernelCost KERNEL_COSTS[] = {
+    KERNEL_COST(gray_to_bgra, 0.233),
+    KERNEL_COST(gray_to_rgba, 0.251),
+    KERNEL_COST(gray_to_i420, 0.243),
+    KERNEL_COST(gray_to_nv12, 0.256),
+    KERNEL_COST(gray_to_uyvy, 0.315),
+    KERNEL_COST(rgb_to_bgra, 0.434),
+    KERNEL_COST(rgb_to_rgba, 0.359),
+    KERNEL_COST(rgb_to_i420, 0.379),
+    KERNEL_COST(rgb_to_nv12, 0.406),
+    KERNEL_COST(rgb_to_uyvy, 0.780),
+    KERNEL_COST(bgr_to_bgra, 0.369),
+    KERNEL_COST(bgr_to_rgba, 0.428),
+    KERNEL_COST(bgr_to_i420, 0.448),
+    KERNEL_COST(bgr_to_nv12, 0.462),
+    KERNEL_COST(bgr_to_uyvy, 0.623),
+    KERNEL_COST(bgra_to_rgba, 0.342),
+    KERNEL_COST(bgra_to_nv12, 0.277),
+    KERNEL_COST(bgra_to_uyvy, 0.597),
+    KERNEL_COST(i420_to_bgra, 0.256),
+    KERNEL_COST(i420_to_rgba, 0.297),
+    KERNEL_COST(i420_to_gray, 0.242),
+    KERNEL_COST(i420_to_nv12, 0.133),
+    KERNEL_COST(i420_to_uyvy, 0.179),
+    KERNEL_COST(nv12_to_bgra, 0.330),
+    KERNEL_COST(nv12_to_rgba, 0.305),
+    KERNEL_COST(nv12_to_i420, 0.158),
+    KERNEL_COST(nv12_to_uyvy, 0.204),
+    KERNEL_COST(i422_to_rgba, 0.345),
+    KERNEL_COST(i422_to_i420, 0.178),
+    KERNEL_COST(i422_to_nv12, 0.226),
+    KERNEL_COST(i422_to_uyvy, 0.196),
+    KERNEL_COST(yuyv_to_bgra, 0.294),
+    KERNEL_COST(yuyv_to_rgba, 0.530),
+    KERNEL_COST(yuyv_to_i420, 0.192),
+    KERNEL_COST(yuyv_to_nv12, 0.189),
+    KERNEL_COST(yuyv_to_i422, 0.206),
+    KERNEL_COST(yuyv_to_uyvy, 0.213),
+    KERNEL_COST(uyvy_to_bgra, 0.315),
+    KERNEL_COST(uyvy_to_rgba, 0.543),
+    KERNEL_COST(uyvy_to_nv12, 0.182),
+};
+
+// Longer paths are never cheaper than a direct kernel in practice.
+static constexpr size_t MAX_CONVERSION_STEPS = 3;
+
+// Whether passing through `via` on the way from src to dst keeps everything
+// that dst can represent. Without this, the cheapest path from RGB to UYVY would
+// go through I420 and lose half of the vertical chroma resolution.
+static bool is_lossless_via(const FormatInfo& src, const FormatInfo& via, const FormatInfo& dst) {
+    if (src.model == ColorModel::GRAY) {
+        return true;
+    }
+    if (via.model == ColorModel::GRAY) {
+        return false;
+    }
+    return via.chroma_hshift <= std::max(src.chroma_hshift, dst.chroma_hshift) &&
+           via.chroma_vshift <= std::max(src.chroma_vshift, dst.chroma_vshift);
+}
+
+// Number of changes of color model along a path starting at src.
+// Each change between RGB and YUV rounds the pixel values,
+// so a path must not change the model more often than needed.
+static int color_model_changes(const FormatInfo& src, const std::vector<const KernelCost*>& path) {
+    int changes = 0;
+    ColorModel model = src.model;
+    for (const KernelCost* step : path) {
+        ColorModel next = format_info(step->kernel->dst_fourcc).model;
+        changes += next != model;
+        model = next;
+    }
+    return changes;
+}
+
+class ConversionPlan {
+  private:
+    int32_t _width = 0;
+    int32_t _height = 0;
+    std::vector<const KernelCost*> _steps;
+    double _cost = 0;
+    // The whole plan if it has at most one step, chosen once here
+    // so that converting a frame is a single call.
+    ConvertFrame _convert = nullptr;
+    // Intermediate frames alternate between two buffers,
+    // so at most two are allocated however long the path is.
+    std::vector<uint8_t> _temporaries[2];
+    Planes _temporary_planes[2];
+
+    void find_path(const FormatInfo& src, const FormatInfo& dst,
+                   std::vector<const KernelCost*>& path, double cost, double& best_cost) {
+        uint32_t fourcc = path.empty() ? src.fourcc : path.back()->kernel->dst_fourcc;
+        if (fourcc == dst.fourcc) {
+            int max_changes = src.model != dst.model ? 1 : 0;
+            if (cost < best_cost && color_model_changes(src, path) <= max_changes) {
+                best_cost = cost;
+                _steps = path;
+            }
+            return;
+        }
+        if (path.size() == MAX_CONVERSION_STEPS) {
+            return;
+        }
+        for (const KernelCost& edge : KERNEL_COSTS) {
+            if (edge.kernel->src_fourcc != fourcc) {
+                continue;
+            }
+            uint32_t next = edge.kernel->dst_fourcc;
+            bool visited = next == src.fourcc || std::any_of(path.begin(), path.end(),
+                [&](const KernelCost* step) { return step->kernel->dst_fourcc == next; });
+            if (visited || (next != dst.fourcc && !is_lossless_via(src, format_info(next), dst))) {
+                continue;
+            }
+            path.push_back(&edge);
+            find_path(src, dst, path, cost + edge.ns_per_pixel, best_cost);
+            path.pop_back();
+        }
+    }
+
+  public:
+    ConversionPlan() = default;
+
+    // Finds the cheapest path and allocates its intermediate frames.
+    ConversionPlan(uint32_t src_fourcc, uint32_t dst_fourcc, int32_t width, int32_t height)
+        : _width(width), _height(height) {
+        if (!find_format(src_fourcc) || !find_format(dst_fourcc)) {
+            throw std::runtime_error("Unsupported image format.");
+        }
+        if (src_fourcc == dst_fourcc) {
+            _convert = copy_frame_of(src_fourcc);
+            return;
+        }
+        std::vector<const KernelCost*> path;
+        double best_cost = std::numeric_limits<double>::infinity();
+        find_path(format_info(src_fourcc), format_info(dst_fourcc), path, 0, best_cost);
+        if (_steps.empty()) {
+            throw std::runtime_error("Unsupported image format.");
+        }
+        _cost = best_cost;
+        if (_steps.size() == 1) {
+            _convert = _steps[0]->convert_frame;
+        }
+        for (size_t i = 0; i + 1 < _steps.size(); i++) {
+            std::vector<uint8_t>& temporary = _temporaries[i % 2];
+            int32_t size = frame_size(_steps[i]->kernel->dst_fourcc, width, height);
+            temporary.resize(std::max<size_t>(temporary.size(), size));
+        }
+        for (size_t i = 0; i + 1 < _steps.size(); i++) {
+            _temporary_planes[i % 2] = frame_planes(
+                _steps[i]->kernel->dst_fourcc, _temporaries[i % 2].data(), width, height);
+        }
+    }
+
+    // Moving keeps the planes of the temporaries valid, copying would not.
+    ConversionPlan(const ConversionPlan&) = delete;
+    ConversionPlan& operator=(const ConversionPlan&) = delete;
+    ConversionPlan(ConversionPlan&&) = default;
+    ConversionPlan& operator=(ConversionPlan&&) = default;
+
+    // Whether frames are passed on as they are, apart from their layout.
+    bool empty() const {
+        return _steps.empty();
+    }
+
+    // Estimated cost in nanoseconds per pixel.
+    double cost() const {
+        return _cost;
+    }
+
+    // Names of the kernels along the path.
+    std::vector<std::string> path() const {
+        std::vector<std::string> names;
+        for (const KernelCost* step : _steps) {
+            names.push_back(step->name);
+        }
+        return names;
+    }
+
+    // Converts a frame, flipping it vertically if `flip` is true.
+    // Without any steps, the frame is copied into dst, in parallel like a kernel.
+    void operator()(const Planes& src, const Planes& dst, ThreadPool* pool = nullptr,
+                    bool flip = false) const {
+        int32_t height = flip ? -_height : _height;
+        if (_convert) {
+            _convert(src, dst, _width, height, pool);
+            return;
+        }
+        Planes from = src;
+        for (size_t i = 0; i < _steps.size(); i++) {
+            Planes to = i + 1 == _steps.size() ? dst : _temporary_planes[i % 2];
+            // Only the first step flips.
+            _steps[i]->convert_frame(from, to, _width, i == 0 ? height : _height, pool);
+            from = to;
+        }
+    }
+};
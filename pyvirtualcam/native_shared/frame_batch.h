@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "image_formats.h"
+
+// Sends a batch of frames, as done by Camera.send_many() in camera.py.
+// If `pace` is true, frame i is due at the start plus timestamps[i] - timestamps[0] seconds,
+// or plus i / fps if there are no timestamps, and sending waits until then.
+// A frame is dropped, that is, neither converted nor sent,
+// if the next one is due already, so that a batch never falls behind its schedule.
+// The last frame is always sent.
+// Returns the number of frames sent and dropped.
+static std::pair<size_t, size_t> send_batch(const std::vector<Planes>& frames,
+                                            const double* timestamps, double fps, bool pace,
+                                            const std::function<void(const Planes&)>& send) {
+    using clock = std::chrono::steady_clock;
+    auto due = [&](size_t i) {
+        double seconds = timestamps ? timestamps[i] - timestamps[0] : i / fps;
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+    };
+    clock::time_point start = clock::now();
+    size_t sent = 0;
+    size_t dropped = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (pace) {
+            if (i + 1 < frames.size() && clock::now() >= start + due(i + 1)) {
+                dropped++;
+                continue;
+            }
+            std::this_thread::sleep_until(start + due(i));
+        }
+        send(frames[i]);
+        sent++;
+    }
+    return { sent, dropped };
+}
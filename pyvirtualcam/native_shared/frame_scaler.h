@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "image_formats.h"
+
+// How a frame is fit into a camera of another size.
+enum class Fit {
+    // Scale to the camera size, changing the aspect ratio if it differs.
+    STRETCH,
+    // Scale to fit within the camera, with black bars at the sides or at the top and bottom.
+    LETTERBOX,
+    // Scale to cover the camera, cutting off the sides or the top and bottom.
+    CROP,
+};
+
+static Fit parse_fit(const std::string& name) {
+    if (name == "stretch") {
+        return Fit::STRETCH;
+    } else if (name == "letterbox") {
+        return Fit::LETTERBOX;
+    } else if (name == "crop") {
+        return Fit::CROP;
+    }
+    throw std::invalid_argument(
+        "Unknown fit '" + name + "', expected 'stretch', 'letterbox' or 'crop'."
+    );
+}
+
+static libyuv::FilterMode parse_filter(const std::string& name) {
+    if (name == "point") {
+        return libyuv::kFilterNone;
+    } else if (name == "bilinear") {
+        return libyuv::kFilterBilinear;
+    } else if (name == "box") {
+        return libyuv::kFilterBox;
+    }
+    throw std::invalid_argument(
+        "Unknown filter '" + name + "', expected 'point', 'bilinear' or 'box'."
+    );
+}
+
+// A rectangle within a frame. Offsets are even, and so are sizes unless it is the whole frame,
+// so that they fall on whole chroma samples of subsampled formats.
+struct FrameRect {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+// Throws unless the rectangle lies within a frame of the given size
+// and falls on whole chroma samples of its format. `what` names it in the message.
+static void check_rect(const FormatInfo& format, const FrameRect& rect, int32_t width, int32_t height,
+                       const std::string& what) {
+    int32_t hmask = (1 << format.chroma_hshift) - 1;
+    int32_t vmask = (1 << format.chroma_vshift) - 1;
+    if (rect.width <= 0 || rect.height <= 0 || rect.x < 0 || rect.y < 0 ||
+            rect.x + rect.width > width || rect.y + rect.height > height) {
+        throw std::invalid_argument(what + " must be within the frame.");
+    }
+    if ((rect.x | rect.width) & hmask || (rect.y | rect.height) & vmask) {
+        throw std::invalid_argument(
+            what + " must be aligned to the chroma samples of " + format.name +
+            " frames, e.g. have an even position and size.");
+    }
+}
+
+// Largest rectangle with the aspect ratio of aspect_width:aspect_height
+// that fits into a frame of the given size, centered.
+static FrameRect fit_rect(int32_t width, int32_t height, int32_t aspect_width, int32_t aspect_height) {
+    FrameRect rect { 0, 0, width, height };
+    if (int64_t(width) * aspect_height > int64_t(height) * aspect_width) {
+        rect.width = int32_t(std::lround(double(height) * aspect_width / aspect_height)) & ~1;
+    } else {
+        rect.height = int32_t(std::lround(double(width) * aspect_height / aspect_width)) & ~1;
+    }
+    rect.width = std::max(rect.width, 2);
+    rect.height = std::max(rect.height, 2);
+    rect.x = ((width - rect.width) / 2) & ~1;
+    rect.y = ((height - rect.height) / 2) & ~1;
+    return rect;
+}
+
+// Planes of the given rectangle of a frame.
+static Planes rect_planes(const FormatInfo& format, Planes planes, const FrameRect& rect) {
+    for (int i = 0; i < format.plane_count; i++) {
+        const PlaneInfo& info = format.planes[i];
+        planes.data[i] += (rect.y >> info.vshift) * planes.stride[i] +
+                          ((rect.x * info.bytes) >> info.hshift);
+    }
+    return planes;
+}
+
+// Scales a frame, or a rectangle of it, into another in the same format with libyuv.
+// There are no scalers for YUYV and UYVY.
+static void scale_planes(const FormatInfo& format, const Planes& src, int32_t src_width, int32_t src_height,
+                         const Planes& dst, int32_t dst_width, int32_t dst_height,
+                         libyuv::FilterMode filter) {
+    switch (format.fourcc) {
+        case libyuv::FOURCC_J400:
+            libyuv::ScalePlane(
+                src.data[0], src.stride[0], src_width, src_height,
+                dst.data[0], dst.stride[0], dst_width, dst_height,
+                filter);
+            break;
+        case libyuv::FOURCC_RAW:
+        case libyuv::FOURCC_24BG:
+            // The order of the channels does not matter.
+            libyuv::RGBScale(
+                src.data[0], src.stride[0], src_width, src_height,
+                dst.data[0], dst.stride[0], dst_width, dst_height,
+                filter);
+            break;
+        case libyuv::FOURCC_ARGB:
+        case libyuv::FOURCC_ABGR:
+            libyuv::ARGBScale(
+                src.data[0], src.stride[0], src_width, src_height,
+                dst.data[0], dst.stride[0], dst_width, dst_height,
+                filter);
+            break;
+        case libyuv::FOURCC_I420:
+            libyuv::I420Scale(
+                src.data[0], src.stride[0],
+                src.data[1], src.stride[1],
+                src.data[2], src.stride[2],
+                src_width, src_height,
+                dst.data[0], dst.stride[0],
+                dst.data[1], dst.stride[1],
+                dst.data[2], dst.stride[2],
+                dst_width, dst_height,
+                filter);
+            break;
+        case libyuv::FOURCC_I422:
+            libyuv::I422Scale(
+                src.data[0], src.stride[0],
+                src.data[1], src.stride[1],
+                src.data[2], src.stride[2],
+                src_width, src_height,
+                dst.data[0], dst.stride[0],
+                dst.data[1], dst.stride[1],
+                dst.data[2], dst.stride[2],
+                dst_width, dst_height,
+                filter);
+            break;
+        case libyuv::FOURCC_NV12:
+            libyuv::NV12Scale(
+                src.data[0], src.stride[0],
+                src.data[1], src.stride[1],
+                src_width, src_height,
+                dst.data[0], dst.stride[0],
+                dst.data[1], dst.stride[1],
+                dst_width, dst_height,
+                filter);
+            break;
+        default:
+            throw std::invalid_argument(
+                std::string("Frames in ") + format.name + " format cannot be scaled.");
+    }
+}
+
+// Whether scale_planes supports the format.
+static bool can_scale(const FormatInfo& format) {
+    return format.fourcc != libyuv::FOURCC_YUY2 && format.fourcc != libyuv::FOURCC_UYVY;
+}
+
+// Fills a frame with black, opaque if the format has alpha.
+static void fill_black(const FormatInfo& format, const Planes& planes, int32_t width, int32_t height) {
+    if (plane_row_size(format, 0, width) == width * 4) {
+        // A = 255, B = G = R = 0 in libyuv's register order, the same for BGRA and RGBA.
+        libyuv::ARGBRect(planes.data[0], planes.stride[0], 0, 0, width, height, 0xff000000);
+        return;
+    }
+    for (int i = 0; i < format.plane_count; i++) {
+        // Limited range YUV, whereas RGB and gray (J400) are full range.
+        uint32_t value = format.model != ColorModel::YUV ? 0 : i == 0 ? 16 : 128;
+        libyuv::SetPlane(
+            planes.data[i], planes.stride[i],
+            plane_row_size(format, i, width), height >> format.planes[i].vshift,
+            value);
+    }
+}
+
+// Scales frames sent in one size to the size of the camera, in the format they are sent in,
+// before they are converted to the native format. Scaling first saves converting
+// the pixels that are dropped when scaling down or cropping.
+// Cropping only moves the start of the planes, and the bars of a letterbox are filled
+// once up front, so that each frame is scaled straight into its place.
+class FrameScaler {
+  private:
+    const FormatInfo& _format;
+    libyuv::FilterMode _filter;
+    // The part of the input that is used, and where it ends up in the output.
+    FrameRect _src_rect;
+    FrameRect _dst_rect;
+    std::vector<uint8_t> _buffer;
+    Planes _planes;
+    Planes _dst_planes;
+
+  public:
+    FrameScaler(uint32_t fourcc, int32_t input_width, int32_t input_height,
+                int32_t width, int32_t height, Fit fit, libyuv::FilterMode filter)
+        : _format(format_info(fourcc)), _filter(filter),
+          _src_rect { 0, 0, input_width, input_height }, _dst_rect { 0, 0, width, height } {
+        if (input_width <= 0 || input_height <= 0) {
+            throw std::invalid_argument("Input width and height must be positive.");
+        }
+        if (!can_scale(_format)) {
+            throw std::invalid_argument(
+                std::string("Frames in ") + _format.name + " format cannot be scaled.");
+        }
+        if (fit == Fit::LETTERBOX) {
+            _dst_rect = fit_rect(width, height, input_width, input_height);
+        } else if (fit == Fit::CROP) {
+            _src_rect = fit_rect(input_width, input_height, width, height);
+        }
+        _buffer.resize(frame_size(fourcc, width, height));
+        _planes = frame_planes(fourcc, _buffer.data(), width, height);
+        fill_black(_format, _planes, width, height);
+        _dst_planes = rect_planes(_format, _planes, _dst_rect);
+    }
+
+    // Scales a frame and returns the planes of the result,
+    // which are valid until the next call.
+    const Planes& operator()(const Planes& frame) {
+        scale_planes(_format, rect_planes(_format, frame, _src_rect), _src_rect.width, _src_rect.height,
+                     _dst_planes, _dst_rect.width, _dst_rect.height, _filter);
+        return _planes;
+    }
+};
+
+// The scaler of frames of input_size, if given, to the given size,
+// or nullptr if frames are sent in that size.
+// The fit and filter are parsed either way, so that typos do not go unnoticed.
+static std::unique_ptr<FrameScaler> make_frame_scaler(uint32_t fourcc, const std::tuple<uint32_t, uint32_t>& size,
+                                                      const std::optional<std::tuple<uint32_t, uint32_t>>& input_size,
+                                                      const std::string& fit, const std::string& filter) {
+    Fit fit_mode = parse_fit(fit);
+    libyuv::FilterMode filter_mode = parse_filter(filter);
+    if (!input_size || *input_size == size) {
+        return nullptr;
+    }
+    auto [width, height] = size;
+    return std::make_unique<FrameScaler>(
+        libyuv::CanonicalFourCC(fourcc), int32_t(std::get<0>(*input_size)), int32_t(std::get<1>(*input_size)),
+        int32_t(width), int32_t(height), fit_mode, filter_mode);
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "image_formats.h"
+
+static libyuv::RotationMode parse_rotation(uint32_t degrees) {
+    switch (degrees) {
+        case 0: return libyuv::kRotate0;
+        case 90: return libyuv::kRotate90;
+        case 180: return libyuv::kRotate180;
+        case 270: return libyuv::kRotate270;
+    }
+    throw std::invalid_argument(
+        "Unsupported rotation " + std::to_string(degrees) + ", expected 0, 90, 180 or 270.");
+}
+
+// Size of a frame that is width x height once rotated by the given angle.
+static std::tuple<uint32_t, uint32_t> unrotated_size(uint32_t width, uint32_t height, uint32_t rotate) {
+    if (rotate == 90 || rotate == 270) {
+        return { height, width };
+    }
+    return { width, height };
+}
+
+// Rotates 3-byte pixels by 90 degrees clockwise, or counterclockwise if `clockwise` is false,
+// as libyuv has no such rotation. Goes through the frame in tiles, so that both the rows
+// read and the rows written stay in the cache.
+static void rotate_rgb24_90(const uint8_t* src, int32_t src_stride, uint8_t* dst, int32_t dst_stride,
+                            int32_t width, int32_t height, bool clockwise) {
+    constexpr int32_t TILE = 32;
+    for (int32_t tile_y = 0; tile_y < height; tile_y += TILE) {
+        for (int32_t tile_x = 0; tile_x < width; tile_x += TILE) {
+            int32_t end_y = std::min(tile_y + TILE, height);
+            int32_t end_x = std::min(tile_x + TILE, width);
+            for (int32_t y = tile_y; y < end_y; y++) {
+                const uint8_t* row = src + int64_t(y) * src_stride;
+                for (int32_t x = tile_x; x < end_x; x++) {
+                    int32_t dst_x = clockwise ? height - 1 - y : y;
+                    int32_t dst_y = clockwise ? x : width - 1 - x;
+                    std::memcpy(dst + int64_t(dst_y) * dst_stride + dst_x * 3, row + x * 3, 3);
+                }
+            }
+        }
+    }
+}
+
+// Rotates a frame into another in the same format with libyuv, where dst is
+// height x width for 90 and 270 degrees. There are no rotations for YUYV and UYVY.
+static void rotate_planes(const FormatInfo& format, const Planes& src, const Planes& dst,
+                          int32_t width, int32_t height, libyuv::RotationMode mode) {
+    switch (format.fourcc) {
+        case libyuv::FOURCC_J400:
+            libyuv::RotatePlane(
+                src.data[0], src.stride[0],
+                dst.data[0], dst.stride[0],
+                width, height, mode);
+            break;
+        case libyuv::FOURCC_RAW:
+        case libyuv::FOURCC_24BG:
+            // The order of the channels does not matter.
+            if (mode == libyuv::kRotate180) {
+                // Mirroring the vertically flipped frame.
+                libyuv::RGB24Mirror(
+                    src.data[0], src.stride[0],
+                    dst.data[0], dst.stride[0],
+                    width, -height);
+            } else {
+                rotate_rgb24_90(
+                    src.data[0], src.stride[0],
+                    dst.data[0], dst.stride[0],
+                    width, height, mode == libyuv::kRotate90);
+            }
+            break;
+        case libyuv::FOURCC_ARGB:
+        case libyuv::FOURCC_ABGR:
+            libyuv::ARGBRotate(
+                src.data[0], src.stride[0],
+                dst.data[0], dst.stride[0],
+                width, height, mode);
+            break;
+        case libyuv::FOURCC_I420:
+            libyuv::I420Rotate(
+                src.data[0], src.stride[0],
+                src.data[1], src.stride[1],
+                src.data[2], src.stride[2],
+                dst.data[0], dst.stride[0],
+                dst.data[1], dst.stride[1],
+                dst.data[2], dst.stride[2],
+                width, height, mode);
+            break;
+        case libyuv::FOURCC_I422:
+            libyuv::I422Rotate(
+                src.data[0], src.stride[0],
+                src.data[1], src.stride[1],
+                src.data[2], src.stride[2],
+                dst.data[0], dst.stride[0],
+                dst.data[1], dst.stride[1],
+                dst.data[2], dst.stride[2],
+                width, height, mode);
+            break;
+        case libyuv::FOURCC_NV12:
+            if (src.stride[1] % 2 != 0) {
+                throw std::invalid_argument("NV12 frames with rows of odd stride cannot be rotated.");
+            }
+            libyuv::RotatePlane(
+                src.data[0], src.stride[0],
+                dst.data[0], dst.stride[0],
+                width, height, mode);
+            // Each UV pair is rotated as one 16-bit sample, with strides in samples.
+            libyuv::RotatePlane_16(
+                reinterpret_cast<const uint16_t*>(src.data[1]), src.stride[1] / 2,
+                reinterpret_cast<uint16_t*>(dst.data[1]), dst.stride[1] / 2,
+                (width + 1) / 2, (height + 1) / 2, mode);
+            break;
+        default:
+            throw std::invalid_argument(
+                std::string("Frames in ") + format.name + " format cannot be rotated or mirrored.");
+    }
+}
+
+// Mirrors frames horizontally, like a selfie view, and then rotates them clockwise,
+// in the format they are sent in, before they are converted to the native format.
+//
+// Mirroring is the same as flipping vertically and rotating by 180 degrees,
+// so any combination is a vertical flip followed by one rotation.
+// The flip is free, as it only negates the strides, and so is mirroring
+// combined with a rotation by 180 degrees, which leaves no rotation.
+// Otherwise libyuv rotates the flipped view in one pass.
+class FrameTransform {
+  private:
+    const FormatInfo& _format;
+    bool _flip;
+    libyuv::RotationMode _mode;
+    // Size of the frames before the transform.
+    int32_t _width;
+    int32_t _height;
+    std::vector<uint8_t> _buffer;
+    Planes _planes;
+
+  public:
+    FrameTransform(uint32_t fourcc, int32_t width, int32_t height, bool mirror, uint32_t rotate)
+        : _format(format_info(fourcc)), _flip(mirror),
+          _mode(parse_rotation(mirror ? (rotate + 180) % 360 : rotate)),
+          _width(width), _height(height) {
+        if (fourcc == libyuv::FOURCC_YUY2 || fourcc == libyuv::FOURCC_UYVY) {
+            throw std::invalid_argument(
+                std::string("Frames in ") + _format.name + " format cannot be rotated or mirrored.");
+        }
+        if (_mode != libyuv::kRotate0) {
+            auto [out_width, out_height] = unrotated_size(width, height, _mode);
+            _buffer.resize(frame_size(fourcc, out_width, out_height));
+            _planes = frame_planes(fourcc, _buffer.data(), out_width, out_height);
+        }
+    }
+
+    // Transforms a frame and returns the planes of the result,
+    // which are valid until the next call.
+    const Planes& operator()(const Planes& frame) {
+        Planes src = _flip ? flip_planes(_format, frame, _height) : frame;
+        if (_mode == libyuv::kRotate0) {
+            _planes = src;
+        } else {
+            rotate_planes(_format, src, _planes, _width, _height, _mode);
+        }
+        return _planes;
+    }
+};
+
+// The transform of a camera of the given size, or nullptr if frames are sent as they are.
+// The rotation is checked either way.
+static std::unique_ptr<FrameTransform> make_frame_transform(uint32_t fourcc, uint32_t width, uint32_t height,
+                                                            bool mirror, uint32_t rotate) {
+    parse_rotation(rotate);
+    if (!mirror && rotate == 0) {
+        return nullptr;
+    }
+    auto [input_width, input_height] = unrotated_size(width, height, rotate);
+    return std::make_unique<FrameTransform>(
+        libyuv::CanonicalFourCC(fourcc), int32_t(input_width), int32_t(input_height), mirror, rotate);
+}
@@ -1,284 +1,848 @@
 #pragma once
 
 #include <cmath>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
 #include <libyuv.h>
+#include "thread_pool.h"
 
 // libyuv names RGBA-type formats after the order in a *register*,
 // whereas we name it after the order in *memory*.
 // For example, libyuv ARGB is referred to as BGRA in function names below.
 
-// Passing a negative height to the functions below flips the image vertically.
+// Passing a negative height to the kernels below flips the image vertically.
+
+// Pointer and stride (in bytes) of each plane of an image.
+// Packed formats only use the first plane.
+// Rows may be padded (stride larger than the row size) and strides
+// may be negative, for example for a cropped or flipped view of a larger image.
+struct Planes {
+    uint8_t* data[3] = {};
+    int32_t stride[3] = {};
+};
+
+enum class ColorModel {
+    GRAY,
+    RGB,
+    YUV,
+};
+
+// Layout of one plane: bytes per group of pixels sharing a sample,
+// and log2 of the horizontal and vertical subsampling.
+// For example, the UV plane of NV12 has 2 bytes per 2x2 pixels.
+struct PlaneInfo {
+    int32_t bytes;
+    int32_t hshift;
+    int32_t vshift;
+};
+
+// Descriptor of a supported format.
+// chroma_hshift/chroma_vshift is the chroma subsampling of the format,
+// which is not always apparent from its planes (e.g. YUYV).
+struct FormatInfo {
+    uint32_t fourcc;
+    const char* name;
+    ColorModel model;
+    int32_t chroma_hshift;
+    int32_t chroma_vshift;
+    int plane_count;
+    PlaneInfo planes[3];
+};
+
+static constexpr FormatInfo FORMATS[] = {
+    { libyuv::FOURCC_J400, "gray", ColorModel::GRAY, 0, 0, 1, { {1, 0, 0} } },
+    { libyuv::FOURCC_RAW, "rgb", ColorModel::RGB, 0, 0, 1, { {3, 0, 0} } },
+    { libyuv::FOURCC_24BG, "bgr", ColorModel::RGB, 0, 0, 1, { {3, 0, 0} } },
+    { libyuv::FOURCC_ARGB, "bgra", ColorModel::RGB, 0, 0, 1, { {4, 0, 0} } },
+    { libyuv::FOURCC_ABGR, "rgba", ColorModel::RGB, 0, 0, 1, { {4, 0, 0} } },
+    { libyuv::FOURCC_I420, "i420", ColorModel::YUV, 1, 1, 3, { {1, 0, 0}, {1, 1, 1}, {1, 1, 1} } },
+    { libyuv::FOURCC_NV12, "nv12", ColorModel::YUV, 1, 1, 2, { {1, 0, 0}, {2, 1, 1} } },
+    { libyuv::FOURCC_I422, "i422", ColorModel::YUV, 1, 0, 3, { {1, 0, 0}, {1, 1, 0}, {1, 1, 0} } },
+    { libyuv::FOURCC_YUY2, "yuyv", ColorModel::YUV, 1, 0, 1, { {2, 0, 0} } },
+    { libyuv::FOURCC_UYVY, "uyvy", ColorModel::YUV, 1, 0, 1, { {2, 0, 0} } },
+};
+
+// nullptr if the format is not supported.
+static constexpr const FormatInfo* find_format(uint32_t fourcc) {
+    for (const FormatInfo& format : FORMATS) {
+        if (format.fourcc == fourcc) {
+            return &format;
+        }
+    }
+    return nullptr;
+}
 
-// copy
-static void gray_to_bgra(const uint8_t *gray, uint8_t* bgra, int32_t width, int32_t height) {
-    libyuv::J400ToARGB(
-        gray, width,
-        bgra, width * 4,
-        width, height);
+static constexpr const FormatInfo& format_info(uint32_t fourcc) {
+    const FormatInfo* format = find_format(fourcc);
+    if (!format) {
+        throw std::logic_error("not implemented");
+    }
+    return *format;
 }
 
-// copy
-static void rgb_to_bgra(const uint8_t *rgb, uint8_t* bgra, int32_t width, int32_t height) {
-    libyuv::RAWToARGB(
-        rgb, width * 3,
-        bgra, width * 4,
-        width, height);
+// Descriptor of a format known at compile time. Helpers below that take
+// a descriptor are fully inlined with it, e.g. loops over planes are unrolled.
+template <uint32_t FOURCC>
+static constexpr const FormatInfo& FORMAT = format_info(FOURCC);
+
+static int plane_count(uint32_t fourcc) {
+    return format_info(fourcc).plane_count;
 }
 
-// copy
-static void bgra_to_rgba(const uint8_t *bgra, uint8_t* rgba, int32_t width, int32_t height) {
-    libyuv::ARGBToABGR(
-        bgra, width * 4,
-        rgba, width * 4,
-        width, height);
+// Size in bytes of a row of the given plane, without padding.
+static int32_t plane_row_size(const FormatInfo& format, int plane, int32_t width) {
+    const PlaneInfo& info = format.planes[plane];
+    return (width * info.bytes) >> info.hshift;
+}
+
+static int32_t plane_row_size(uint32_t fourcc, int plane, int32_t width) {
+    return plane_row_size(format_info(fourcc), plane, width);
+}
+
+// log2 of the vertical subsampling of the given plane.
+static int32_t plane_vshift(uint32_t fourcc, int plane) {
+    return format_info(fourcc).planes[plane].vshift;
+}
+
+// Size in bytes of a contiguous frame, as laid out by frame_planes().
+static int32_t frame_size(uint32_t fourcc, int32_t width, int32_t height) {
+    int32_t size = 0;
+    for (int i = 0; i < plane_count(fourcc); i++) {
+        size += plane_row_size(fourcc, i, width) * (height >> plane_vshift(fourcc, i));
+    }
+    return size;
+}
+
+// Planes of a frame stored contiguously in memory, which is how frames
+// are produced by the backends and by the *_frame_size() functions below.
+static Planes frame_planes(uint32_t fourcc, const uint8_t* frame, int32_t width, int32_t height) {
+    uint8_t* data = const_cast<uint8_t*>(frame);
+    Planes planes;
+    for (int i = 0; i < plane_count(fourcc); i++) {
+        planes.data[i] = data;
+        planes.stride[i] = plane_row_size(fourcc, i, width);
+        data += planes.stride[i] * (height >> plane_vshift(fourcc, i));
+    }
+    return planes;
+}
+
+// Whether the planes are laid out like frame_planes(), so that the frame
+// can be used as a single block of memory.
+static bool is_contiguous(uint32_t fourcc, const Planes& planes, int32_t width, int32_t height) {
+    Planes contiguous = frame_planes(fourcc, planes.data[0], width, height);
+    for (int i = 0; i < plane_count(fourcc); i++) {
+        if (planes.data[i] != contiguous.data[i] || planes.stride[i] != contiguous.stride[i]) {
+            return false;
+        }
+    }
+    return true;
 }
 
 // copy
-static void bgra_to_bgra(const uint8_t *src, uint8_t* dist, int32_t width, int32_t height) {
-    libyuv::ARGBCopy(
-        src, width * 4,
-        dist, width * 4,
-        width, height);
+// Copies a frame between two layouts of the same format, for example
+// from padded rows into a contiguous frame.
+static void copy_planes(const FormatInfo& format, const Planes& src, const Planes& dst,
+                        int32_t width, int32_t height) {
+    for (int i = 0; i < format.plane_count; i++) {
+        libyuv::CopyPlane(
+            src.data[i], src.stride[i],
+            dst.data[i], dst.stride[i],
+            plane_row_size(format, i, width), height >> format.planes[i].vshift);
+    }
 }
 
-#define rgba_to_rgba bgra_to_bgra
+static void copy_planes(uint32_t fourcc, const Planes& src, const Planes& dst,
+                        int32_t width, int32_t height) {
+    copy_planes(format_info(fourcc), src, dst, width, height);
+}
 
-// horizontal and vertical subsampling and yuv conversion
-static void rgb_to_i420(const uint8_t *rgb, uint8_t* i420, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    int32_t half_width = width / 2;
-    int32_t half_height = height / 2;
-
-    libyuv::RAWToI420(
-        rgb, width * 3,
-        i420, width,
-        i420 + width * height, half_width,
-        i420 + width * height + half_width * half_height, half_width,
-        width, height_);
+// Planes starting at the given row. `row` must be even for 4:2:0 formats.
+static Planes offset_planes(const FormatInfo& format, Planes planes, int32_t row) {
+    for (int i = 0; i < format.plane_count; i++) {
+        planes.data[i] += (row >> format.planes[i].vshift) * planes.stride[i];
+    }
+    return planes;
+}
+
+static Planes offset_planes(uint32_t fourcc, Planes planes, int32_t row) {
+    return offset_planes(format_info(fourcc), planes, row);
 }
 
+// Planes of the vertically flipped image, using negative strides.
+static Planes flip_planes(const FormatInfo& format, Planes planes, int32_t height) {
+    for (int i = 0; i < format.plane_count; i++) {
+        int32_t shift = format.planes[i].vshift;
+        int32_t plane_height = (height + (1 << shift) - 1) >> shift;
+        planes.data[i] += (plane_height - 1) * planes.stride[i];
+        planes.stride[i] = -planes.stride[i];
+    }
+    return planes;
+}
+
+static Planes flip_planes(uint32_t fourcc, Planes planes, int32_t height) {
+    return flip_planes(format_info(fourcc), planes, height);
+}
+
+// Minimum number of rows per band when converting in parallel.
+// Smaller bands are not worth the synchronization overhead.
+static constexpr int32_t MIN_PARALLEL_BAND_HEIGHT = 64;
+
+// Calls convert(src, dst, width, height) for a whole frame, flipping it if height
+// is negative, and splits it into horizontal bands that run in parallel if a thread pool
+// with more than one thread is given. The result is the same in all cases.
+template <typename Convert>
+static void convert_in_bands(const FormatInfo& src_format, const FormatInfo& dst_format,
+                             Convert convert,
+                             Planes src, const Planes& dst, int32_t width, int32_t height,
+                             ThreadPool* pool) {
+    if (height < 0) {
+        height = -height;
+        src = flip_planes(src_format, src, height);
+    }
+    size_t bands = pool ? pool->size() : 1;
+    bands = std::min<size_t>(bands, std::max(1, height / MIN_PARALLEL_BAND_HEIGHT));
+    if (bands <= 1) {
+        convert(src, dst, width, height);
+        return;
+    }
+    // Keep bands aligned to chroma rows of 4:2:0 formats.
+    int32_t band_height = static_cast<int32_t>((height + bands - 1) / bands);
+    band_height += band_height % 2;
+    pool->run(bands, [&](size_t i) {
+        int32_t row = static_cast<int32_t>(i) * band_height;
+        if (row >= height) {
+            return;
+        }
+        convert(
+            offset_planes(src_format, src, row),
+            offset_planes(dst_format, dst, row),
+            width, std::min(band_height, height - row));
+    });
+}
+
+// A conversion between two formats, identified by libyuv FourCC codes.
+// `convert` converts rows [0, height) of the given planes, where height is positive.
+// Calling a kernel converts a whole frame as in convert_in_bands().
+struct Kernel {
+    uint32_t src_fourcc;
+    uint32_t dst_fourcc;
+    void (*convert)(const Planes& src, const Planes& dst, int32_t width, int32_t height);
+
+    void operator()(const Planes& src, const Planes& dst, int32_t width, int32_t height,
+                    ThreadPool* pool = nullptr) const {
+        convert_in_bands(format_info(src_fourcc), format_info(dst_fourcc), convert,
+                         src, dst, width, height, pool);
+    }
+
+    void operator()(const uint8_t* src, uint8_t* dst, int32_t width, int32_t height,
+                    ThreadPool* pool = nullptr) const {
+        int32_t abs_height = std::abs(height);
+        (*this)(
+            frame_planes(src_fourcc, src, width, abs_height),
+            frame_planes(dst_fourcc, dst, width, abs_height),
+            width, height, pool);
+    }
+};
+
+// Kernels marked as "fused" convert a frame in bands of BAND_HEIGHT rows.
+// Any intermediate data of a band is kept in a small per-thread scratch buffer
+// that stays in cache, so the frame itself is traversed only once.
+static constexpr int32_t BAND_HEIGHT = 16;
+
+static uint8_t* band_scratch(size_t size) {
+    thread_local std::vector<uint8_t> scratch;
+    if (scratch.size() < size) {
+        scratch.resize(size);
+    }
+    return scratch.data();
+}
+
+// Converts a packed source format to a packed or single-plane destination format
+// through BGRA, one band at a time (fused).
+template <typename ToBGRA, typename FromBGRA>
+static void packed_via_bgra(ToBGRA to_bgra, FromBGRA from_bgra,
+                            const uint8_t *src, int32_t src_stride,
+                            uint8_t* dst, int32_t dst_stride,
+                            int32_t width, int32_t height) {
+    uint8_t* bgra_band = band_scratch(width * 4 * BAND_HEIGHT);
+
+    for (int32_t y = 0; y < height; y += BAND_HEIGHT) {
+        int32_t band_height = std::min(BAND_HEIGHT, height - y);
+        to_bgra(
+            src + y * src_stride, src_stride,
+            bgra_band, width * 4,
+            width, band_height);
+        from_bgra(
+            bgra_band, width * 4,
+            dst + y * dst_stride, dst_stride,
+            width, band_height);
+    }
+}
+
+// copy
+static constexpr Kernel gray_to_bgra {
+    libyuv::FOURCC_J400, libyuv::FOURCC_ARGB,
+    [](const Planes& gray, const Planes& bgra, int32_t width, int32_t height) {
+        libyuv::J400ToARGB(
+            gray.data[0], gray.stride[0],
+            bgra.data[0], bgra.stride[0],
+            width, height);
+    }
+};
+
 // copy
-static void bgr_to_bgra(const uint8_t *bgr, uint8_t* bgra, int32_t width, int32_t height) {
-    libyuv::RGB24ToARGB(
-        bgr, width * 3,
-        bgra, width * 4,
-        width, height);
+// Gray is symmetric in R, G and B, so this is the same as gray_to_bgra.
+static constexpr Kernel gray_to_rgba {
+    libyuv::FOURCC_J400, libyuv::FOURCC_ABGR,
+    gray_to_bgra.convert
+};
+
+// Gray (J400) is full range, whereas the YUV outputs are limited range (BT.601).
+// Luma is computed through BGRA, which keeps it bit-exact with converting
+// the whole frame through BGRA. The chroma of gray is always exactly 128.
+static void gray_to_y(const Planes& gray, const Planes& y, int32_t width, int32_t height) {
+    packed_via_bgra(libyuv::J400ToARGB, libyuv::ARGBToI400,
+                    gray.data[0], gray.stride[0], y.data[0], y.stride[0], width, height);
 }
 
+// yuv conversion (fused)
+static constexpr Kernel gray_to_i420 {
+    libyuv::FOURCC_J400, libyuv::FOURCC_I420,
+    [](const Planes& gray, const Planes& i420, int32_t width, int32_t height) {
+        int32_t half_width = width / 2;
+        int32_t half_height = (height + 1) / 2;
+
+        gray_to_y(gray, i420, width, height);
+        libyuv::SetPlane(
+            i420.data[1], i420.stride[1],
+            half_width, half_height,
+            128);
+        libyuv::SetPlane(
+            i420.data[2], i420.stride[2],
+            half_width, half_height,
+            128);
+    }
+};
+
+// yuv conversion (fused)
+static constexpr Kernel gray_to_nv12 {
+    libyuv::FOURCC_J400, libyuv::FOURCC_NV12,
+    [](const Planes& gray, const Planes& nv12, int32_t width, int32_t height) {
+        int32_t half_height = (height + 1) / 2;
+
+        gray_to_y(gray, nv12, width, height);
+        libyuv::SetPlane(
+            nv12.data[1], nv12.stride[1],
+            width, half_height,
+            128);
+    }
+};
+
+// yuv conversion (fused)
+static constexpr Kernel gray_to_uyvy {
+    libyuv::FOURCC_J400, libyuv::FOURCC_UYVY,
+    [](const Planes& gray, const Planes& uyvy, int32_t width, int32_t height) {
+        int32_t half_width = (width + 1) / 2;
+        uint8_t* bgra_band = band_scratch((width * 5) * BAND_HEIGHT + half_width);
+        uint8_t* y_band = bgra_band + width * 4 * BAND_HEIGHT;
+        uint8_t* chroma_row = y_band + width * BAND_HEIGHT;
+        std::fill(chroma_row, chroma_row + half_width, 128);
+
+        for (int32_t row = 0; row < height; row += BAND_HEIGHT) {
+            int32_t band_height = std::min(BAND_HEIGHT, height - row);
+            libyuv::J400ToARGB(
+                gray.data[0] + row * gray.stride[0], gray.stride[0],
+                bgra_band, width * 4,
+                width, band_height);
+            libyuv::ARGBToI400(
+                bgra_band, width * 4,
+                y_band, width,
+                width, band_height);
+            // A stride of 0 repeats the constant chroma row.
+            libyuv::I422ToUYVY(
+                y_band, width,
+                chroma_row, 0,
+                chroma_row, 0,
+                uyvy.data[0] + row * uyvy.stride[0], uyvy.stride[0],
+                width, band_height);
+        }
+    }
+};
+
+// copy
+static constexpr Kernel rgb_to_bgra {
+    libyuv::FOURCC_RAW, libyuv::FOURCC_ARGB,
+    [](const Planes& rgb, const Planes& bgra, int32_t width, int32_t height) {
+        libyuv::RAWToARGB(
+            rgb.data[0], rgb.stride[0],
+            bgra.data[0], bgra.stride[0],
+            width, height);
+    }
+};
+
+// copy
+// libyuv's RGB24 is BGR in memory, so this only appends alpha.
+static constexpr Kernel rgb_to_rgba {
+    libyuv::FOURCC_RAW, libyuv::FOURCC_ABGR,
+    [](const Planes& rgb, const Planes& rgba, int32_t width, int32_t height) {
+        libyuv::RGB24ToARGB(
+            rgb.data[0], rgb.stride[0],
+            rgba.data[0], rgba.stride[0],
+            width, height);
+    }
+};
+
+// horizontal subsampling and yuv conversion (fused)
+static constexpr Kernel rgb_to_uyvy {
+    libyuv::FOURCC_RAW, libyuv::FOURCC_UYVY,
+    [](const Planes& rgb, const Planes& uyvy, int32_t width, int32_t height) {
+        packed_via_bgra(libyuv::RAWToARGB, libyuv::ARGBToUYVY,
+                        rgb.data[0], rgb.stride[0], uyvy.data[0], uyvy.stride[0],
+                        width, height);
+    }
+};
+
+// copy
+static constexpr Kernel bgra_to_rgba {
+    libyuv::FOURCC_ARGB, libyuv::FOURCC_ABGR,
+    [](const Planes& bgra, const Planes& rgba, int32_t width, int32_t height) {
+        libyuv::ARGBToABGR(
+            bgra.data[0], bgra.stride[0],
+            rgba.data[0], rgba.stride[0],
+            width, height);
+    }
+};
+
+// copy
+static constexpr Kernel bgra_to_bgra {
+    libyuv::FOURCC_ARGB, libyuv::FOURCC_ARGB,
+    [](const Planes& src, const Planes& dst, int32_t width, int32_t height) {
+        libyuv::ARGBCopy(
+            src.data[0], src.stride[0],
+            dst.data[0], dst.stride[0],
+            width, height);
+    }
+};
+
+// copy
+static constexpr Kernel rgba_to_rgba {
+    libyuv::FOURCC_ABGR, libyuv::FOURCC_ABGR,
+    bgra_to_bgra.convert
+};
+
 // horizontal and vertical subsampling and yuv conversion
-static void bgr_to_i420(const uint8_t *bgr, uint8_t* i420, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    int32_t half_width = width / 2;
-    int32_t half_height = height / 2;
-
-    libyuv::RGB24ToI420(
-        bgr, width * 3,
-        i420, width,
-        i420 + width * height, half_width,
-        i420 + width * height + half_width * half_height, half_width,
-        width, height_);
-}
+static constexpr Kernel rgb_to_i420 {
+    libyuv::FOURCC_RAW, libyuv::FOURCC_I420,
+    [](const Planes& rgb, const Planes& i420, int32_t width, int32_t height) {
+        libyuv::RAWToI420(
+            rgb.data[0], rgb.stride[0],
+            i420.data[0], i420.stride[0],
+            i420.data[1], i420.stride[1],
+            i420.data[2], i420.stride[2],
+            width, height);
+    }
+};
+
+// copy
+static constexpr Kernel bgr_to_bgra {
+    libyuv::FOURCC_24BG, libyuv::FOURCC_ARGB,
+    [](const Planes& bgr, const Planes& bgra, int32_t width, int32_t height) {
+        libyuv::RGB24ToARGB(
+            bgr.data[0], bgr.stride[0],
+            bgra.data[0], bgra.stride[0],
+            width, height);
+    }
+};
+
+// copy
+// libyuv's RAW is RGB in memory, so this swaps R and B and appends alpha.
+static constexpr Kernel bgr_to_rgba {
+    libyuv::FOURCC_24BG, libyuv::FOURCC_ABGR,
+    [](const Planes& bgr, const Planes& rgba, int32_t width, int32_t height) {
+        libyuv::RAWToARGB(
+            bgr.data[0], bgr.stride[0],
+            rgba.data[0], rgba.stride[0],
+            width, height);
+    }
+};
+
+// horizontal subsampling and yuv conversion (fused)
+static constexpr Kernel bgr_to_uyvy {
+    libyuv::FOURCC_24BG, libyuv::FOURCC_UYVY,
+    [](const Planes& bgr, const Planes& uyvy, int32_t width, int32_t height) {
+        packed_via_bgra(libyuv::RGB24ToARGB, libyuv::ARGBToUYVY,
+                        bgr.data[0], bgr.stride[0], uyvy.data[0], uyvy.stride[0],
+                        width, height);
+    }
+};
 
 // horizontal and vertical subsampling and yuv conversion
-static void bgra_to_nv12(const uint8_t *bgra, uint8_t* nv12, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    libyuv::ARGBToNV12(
-        bgra, width * 4,
-        nv12, width,
-        nv12 + width * height, width,
-        width, height_);
+static constexpr Kernel bgr_to_i420 {
+    libyuv::FOURCC_24BG, libyuv::FOURCC_I420,
+    [](const Planes& bgr, const Planes& i420, int32_t width, int32_t height) {
+        libyuv::RGB24ToI420(
+            bgr.data[0], bgr.stride[0],
+            i420.data[0], i420.stride[0],
+            i420.data[1], i420.stride[1],
+            i420.data[2], i420.stride[2],
+            width, height);
+    }
+};
+
+// horizontal and vertical subsampling and yuv conversion (fused)
+// Bit-exact with the two-step `*_to_i420` + `i420_to_nv12` conversion.
+template <typename ToI420>
+static void packed_to_nv12(ToI420 to_i420, const Planes& src, const Planes& nv12,
+                           int32_t width, int32_t height) {
+    int32_t half_width = (width + 1) / 2;
+    uint8_t* u_band = band_scratch(half_width * BAND_HEIGHT);
+    uint8_t* v_band = u_band + half_width * (BAND_HEIGHT / 2);
+
+    for (int32_t y = 0; y < height; y += BAND_HEIGHT) {
+        int32_t band_height = std::min(BAND_HEIGHT, height - y);
+        to_i420(
+            src.data[0] + y * src.stride[0], src.stride[0],
+            nv12.data[0] + y * nv12.stride[0], nv12.stride[0],
+            u_band, half_width,
+            v_band, half_width,
+            width, band_height);
+        libyuv::MergeUVPlane(
+            u_band, half_width,
+            v_band, half_width,
+            nv12.data[1] + (y / 2) * nv12.stride[1], nv12.stride[1],
+            half_width, (band_height + 1) / 2);
+    }
 }
 
+static constexpr Kernel rgb_to_nv12 {
+    libyuv::FOURCC_RAW, libyuv::FOURCC_NV12,
+    [](const Planes& rgb, const Planes& nv12, int32_t width, int32_t height) {
+        packed_to_nv12(libyuv::RAWToI420, rgb, nv12, width, height);
+    }
+};
+
+static constexpr Kernel bgr_to_nv12 {
+    libyuv::FOURCC_24BG, libyuv::FOURCC_NV12,
+    [](const Planes& bgr, const Planes& nv12, int32_t width, int32_t height) {
+        packed_to_nv12(libyuv::RGB24ToI420, bgr, nv12, width, height);
+    }
+};
+
+// horizontal and vertical subsampling and yuv conversion
+static constexpr Kernel bgra_to_nv12 {
+    libyuv::FOURCC_ARGB, libyuv::FOURCC_NV12,
+    [](const Planes& bgra, const Planes& nv12, int32_t width, int32_t height) {
+        libyuv::ARGBToNV12(
+            bgra.data[0], bgra.stride[0],
+            nv12.data[0], nv12.stride[0],
+            nv12.data[1], nv12.stride[1],
+            width, height);
+    }
+};
+
 // horizontal subsampling and yuv conversion
-static void bgra_to_uyvy(const uint8_t *bgra, uint8_t* uyvy, int32_t width, int32_t height) {
-    libyuv::ARGBToUYVY(
-        bgra, width * 4,
-        uyvy, width * 2,
-        width, height);
-}
+static constexpr Kernel bgra_to_uyvy {
+    libyuv::FOURCC_ARGB, libyuv::FOURCC_UYVY,
+    [](const Planes& bgra, const Planes& uyvy, int32_t width, int32_t height) {
+        libyuv::ARGBToUYVY(
+            bgra.data[0], bgra.stride[0],
+            uyvy.data[0], uyvy.stride[0],
+            width, height);
+    }
+};
 
 // copy
-static void i420_to_nv12(const uint8_t *i420, uint8_t* nv12, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    int32_t half_width = width / 2;
-    int32_t half_height = height / 2;
-
-    libyuv::I420ToNV12(
-        i420, width,
-        i420 + width * height, half_width,
-        i420 + width * height + half_width * half_height, half_width,
-        nv12, width,
-        nv12 + width * height, width,
-        width, height_);
-}
+static constexpr Kernel i420_to_nv12 {
+    libyuv::FOURCC_I420, libyuv::FOURCC_NV12,
+    [](const Planes& i420, const Planes& nv12, int32_t width, int32_t height) {
+        libyuv::I420ToNV12(
+            i420.data[0], i420.stride[0],
+            i420.data[1], i420.stride[1],
+            i420.data[2], i420.stride[2],
+            nv12.data[0], nv12.stride[0],
+            nv12.data[1], nv12.stride[1],
+            width, height);
+    }
+};
 
 // horizontal and vertical upsampling and yuv conversion
-static void i420_to_bgra(const uint8_t *i420, uint8_t* bgra, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    int32_t half_width = width / 2;
-    int32_t half_height = height / 2;
-
-    libyuv::I420ToARGB(
-        i420, width,
-        i420 + width * height, half_width,
-        i420 + width * height + half_width * half_height, half_width,
-        bgra, width * 4,
-        width, height_);
-}
+static constexpr Kernel i420_to_bgra {
+    libyuv::FOURCC_I420, libyuv::FOURCC_ARGB,
+    [](const Planes& i420, const Planes& bgra, int32_t width, int32_t height) {
+        libyuv::I420ToARGB(
+            i420.data[0], i420.stride[0],
+            i420.data[1], i420.stride[1],
+            i420.data[2], i420.stride[2],
+            bgra.data[0], bgra.stride[0],
+            width, height);
+    }
+};
 
 // horizontal and vertical upsampling and yuv conversion
-static void i420_to_rgba(const uint8_t *i420, uint8_t* rgba, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    int32_t half_width = width / 2;
-    int32_t half_height = height / 2;
-
-    libyuv::I420ToABGR(
-        i420, width,
-        i420 + width * height, half_width,
-        i420 + width * height + half_width * half_height, half_width,
-        rgba, width * 4,
-        width, height_);
-}
+static constexpr Kernel i420_to_rgba {
+    libyuv::FOURCC_I420, libyuv::FOURCC_ABGR,
+    [](const Planes& i420, const Planes& rgba, int32_t width, int32_t height) {
+        libyuv::I420ToABGR(
+            i420.data[0], i420.stride[0],
+            i420.data[1], i420.stride[1],
+            i420.data[2], i420.stride[2],
+            rgba.data[0], rgba.stride[0],
+            width, height);
+    }
+};
+
+// yuv conversion (fused)
+// The inverse of gray_to_y(): limited range luma is expanded to full range through BGRA,
+// chroma is ignored.
+static constexpr Kernel i420_to_gray {
+    libyuv::FOURCC_I420, libyuv::FOURCC_J400,
+    [](const Planes& i420, const Planes& gray, int32_t width, int32_t height) {
+        packed_via_bgra(libyuv::I400ToARGB, libyuv::ARGBToJ400,
+                        i420.data[0], i420.stride[0], gray.data[0], gray.stride[0], width, height);
+    }
+};
 
 // copy
-static void nv12_to_i420(const uint8_t *nv12, uint8_t* i420, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    int32_t half_width = width / 2;
-    int32_t half_height = height / 2;
-
-    libyuv::NV12ToI420(
-        nv12, width,
-        nv12 + width * height, width,
-        i420, width,
-        i420 + width * height, half_width,
-        i420 + width * height + half_width * half_height, half_width,
-        width, height_);
-}
+static constexpr Kernel nv12_to_i420 {
+    libyuv::FOURCC_NV12, libyuv::FOURCC_I420,
+    [](const Planes& nv12, const Planes& i420, int32_t width, int32_t height) {
+        libyuv::NV12ToI420(
+            nv12.data[0], nv12.stride[0],
+            nv12.data[1], nv12.stride[1],
+            i420.data[0], i420.stride[0],
+            i420.data[1], i420.stride[1],
+            i420.data[2], i420.stride[2],
+            width, height);
+    }
+};
 
 // horizontal and vertical upsampling and yuv conversion
-static void nv12_to_bgra(const uint8_t *nv12, uint8_t* bgra, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    libyuv::NV12ToARGB(
-        nv12, width,
-        nv12 + width * height, width,
-        bgra, width * 4,
-        width, height_);
-}
+static constexpr Kernel nv12_to_bgra {
+    libyuv::FOURCC_NV12, libyuv::FOURCC_ARGB,
+    [](const Planes& nv12, const Planes& bgra, int32_t width, int32_t height) {
+        libyuv::NV12ToARGB(
+            nv12.data[0], nv12.stride[0],
+            nv12.data[1], nv12.stride[1],
+            bgra.data[0], bgra.stride[0],
+            width, height);
+    }
+};
 
 // horizontal and vertical upsampling and yuv conversion
-static void nv12_to_rgba(const uint8_t *nv12, uint8_t* rgba, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    libyuv::NV12ToABGR(
-        nv12, width,
-        nv12 + width * height, width,
-        rgba, width * 4,
-        width, height_);
-}
+static constexpr Kernel nv12_to_rgba {
+    libyuv::FOURCC_NV12, libyuv::FOURCC_ABGR,
+    [](const Planes& nv12, const Planes& rgba, int32_t width, int32_t height) {
+        libyuv::NV12ToABGR(
+            nv12.data[0], nv12.stride[0],
+            nv12.data[1], nv12.stride[1],
+            rgba.data[0], rgba.stride[0],
+            width, height);
+    }
+};
+
+// vertical upsampling (fused)
+// Bit-exact with the two-step `nv12_to_i420` + `i420_to_uyvy` conversion.
+static constexpr Kernel nv12_to_uyvy {
+    libyuv::FOURCC_NV12, libyuv::FOURCC_UYVY,
+    [](const Planes& nv12, const Planes& uyvy, int32_t width, int32_t height) {
+        int32_t half_width = (width + 1) / 2;
+        uint8_t* u_band = band_scratch(half_width * BAND_HEIGHT);
+        uint8_t* v_band = u_band + half_width * (BAND_HEIGHT / 2);
+
+        for (int32_t y = 0; y < height; y += BAND_HEIGHT) {
+            int32_t band_height = std::min(BAND_HEIGHT, height - y);
+            libyuv::SplitUVPlane(
+                nv12.data[1] + (y / 2) * nv12.stride[1], nv12.stride[1],
+                u_band, half_width,
+                v_band, half_width,
+                half_width, (band_height + 1) / 2);
+            libyuv::I420ToUYVY(
+                nv12.data[0] + y * nv12.stride[0], nv12.stride[0],
+                u_band, half_width,
+                v_band, half_width,
+                uyvy.data[0] + y * uyvy.stride[0], uyvy.stride[0],
+                width, band_height);
+        }
+    }
+};
 
 // vertical upsampling
-static void i420_to_uyvy(const uint8_t *i420, uint8_t* uyvy, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    int32_t half_width = width / 2;
-    int32_t half_height = height / 2;
-
-    libyuv::I420ToUYVY(
-        i420, width,
-        i420 + width * height, half_width,
-        i420 + width * height + half_width * half_height, half_width,
-        uyvy, width * 2,
-        width, height_);
-}
+static constexpr Kernel i420_to_uyvy {
+    libyuv::FOURCC_I420, libyuv::FOURCC_UYVY,
+    [](const Planes& i420, const Planes& uyvy, int32_t width, int32_t height) {
+        libyuv::I420ToUYVY(
+            i420.data[0], i420.stride[0],
+            i420.data[1], i420.stride[1],
+            i420.data[2], i420.stride[2],
+            uyvy.data[0], uyvy.stride[0],
+            width, height);
+    }
+};
 
 // vertical subsampling
-static void yuyv_to_nv12(const uint8_t *yuyv, uint8_t* nv12, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    libyuv::YUY2ToNV12(
-        yuyv, width * 2,
-        nv12, width,
-        nv12 + width * height, width,
-        width, height_);
-}
+static constexpr Kernel yuyv_to_nv12 {
+    libyuv::FOURCC_YUY2, libyuv::FOURCC_NV12,
+    [](const Planes& yuyv, const Planes& nv12, int32_t width, int32_t height) {
+        libyuv::YUY2ToNV12(
+            yuyv.data[0], yuyv.stride[0],
+            nv12.data[0], nv12.stride[0],
+            nv12.data[1], nv12.stride[1],
+            width, height);
+    }
+};
 
 // vertical subsampling
-static void yuyv_to_i420(const uint8_t *yuyv, uint8_t* i420, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    int32_t half_width = width / 2;
-    int32_t half_height = height / 2;
-
-    libyuv::YUY2ToI420(
-        yuyv, width * 2,
-        i420, width,
-        i420 + width * height, half_width,
-        i420 + width * height + half_width * half_height, half_width,
-        width, height_);
-}
+static constexpr Kernel yuyv_to_i420 {
+    libyuv::FOURCC_YUY2, libyuv::FOURCC_I420,
+    [](const Planes& yuyv, const Planes& i420, int32_t width, int32_t height) {
+        libyuv::YUY2ToI420(
+            yuyv.data[0], yuyv.stride[0],
+            i420.data[0], i420.stride[0],
+            i420.data[1], i420.stride[1],
+            i420.data[2], i420.stride[2],
+            width, height);
+    }
+};
 
 // copy
-static void yuyv_to_i422(const uint8_t *yuyv, uint8_t* i422, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    int32_t half_width = width / 2;
-
-    libyuv::YUY2ToI422(
-        yuyv, width * 2,
-        i422, width,
-        i422 + width * height, half_width,
-        i422 + width * height + half_width * height, half_width,
-        width, height_);
-}
+static constexpr Kernel yuyv_to_i422 {
+    libyuv::FOURCC_YUY2, libyuv::FOURCC_I422,
+    [](const Planes& yuyv, const Planes& i422, int32_t width, int32_t height) {
+        libyuv::YUY2ToI422(
+            yuyv.data[0], yuyv.stride[0],
+            i422.data[0], i422.stride[0],
+            i422.data[1], i422.stride[1],
+            i422.data[2], i422.stride[2],
+            width, height);
+    }
+};
 
 // horizontal upsampling and yuv conversion
-static void yuyv_to_bgra(const uint8_t *yuyv, uint8_t* bgra, int32_t width, int32_t height) {
-    libyuv::YUY2ToARGB(
-        yuyv, width * 2,
-        bgra, width * 4,
-        width, height);
-}
+static constexpr Kernel yuyv_to_bgra {
+    libyuv::FOURCC_YUY2, libyuv::FOURCC_ARGB,
+    [](const Planes& yuyv, const Planes& bgra, int32_t width, int32_t height) {
+        libyuv::YUY2ToARGB(
+            yuyv.data[0], yuyv.stride[0],
+            bgra.data[0], bgra.stride[0],
+            width, height);
+    }
+};
+
+// copy
+// Swaps the bytes of each luma/chroma pair, treating 2 pixels as one BGRA pixel.
+static constexpr Kernel yuyv_to_uyvy {
+    libyuv::FOURCC_YUY2, libyuv::FOURCC_UYVY,
+    [](const Planes& yuyv, const Planes& uyvy, int32_t width, int32_t height) {
+        static const uint8_t swap_pairs[16] = {
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+        };
+        libyuv::ARGBShuffle(
+            yuyv.data[0], yuyv.stride[0],
+            uyvy.data[0], uyvy.stride[0],
+            swap_pairs,
+            width / 2, height);
+    }
+};
+
+// horizontal upsampling and yuv conversion (fused)
+static constexpr Kernel yuyv_to_rgba {
+    libyuv::FOURCC_YUY2, libyuv::FOURCC_ABGR,
+    [](const Planes& yuyv, const Planes& rgba, int32_t width, int32_t height) {
+        packed_via_bgra(libyuv::YUY2ToARGB, libyuv::ARGBToABGR,
+                        yuyv.data[0], yuyv.stride[0], rgba.data[0], rgba.stride[0],
+                        width, height);
+    }
+};
 
 // vertical subsampling
-static void uyvy_to_nv12(const uint8_t *uyvy, uint8_t* nv12, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    libyuv::UYVYToNV12(
-        uyvy, width * 2,
-        nv12, width,
-        nv12 + width * height, width,
-        width, height_);
-}
+static constexpr Kernel uyvy_to_nv12 {
+    libyuv::FOURCC_UYVY, libyuv::FOURCC_NV12,
+    [](const Planes& uyvy, const Planes& nv12, int32_t width, int32_t height) {
+        libyuv::UYVYToNV12(
+            uyvy.data[0], uyvy.stride[0],
+            nv12.data[0], nv12.stride[0],
+            nv12.data[1], nv12.stride[1],
+            width, height);
+    }
+};
 
 // copy
-static void i422_to_uyvy(const uint8_t *i422, uint8_t* uyvy, int32_t width, int32_t height) {
-    int32_t height_ = height;
-    height = std::abs(height);
-    int32_t half_width = width / 2;
-
-    libyuv::I422ToUYVY(
-        i422, width,
-        i422 + width * height, half_width,
-        i422 + width * height + half_width * height, half_width,
-        uyvy, width * 2,
-        width, height_);
-}
+static constexpr Kernel i422_to_uyvy {
+    libyuv::FOURCC_I422, libyuv::FOURCC_UYVY,
+    [](const Planes& i422, const Planes& uyvy, int32_t width, int32_t height) {
+        libyuv::I422ToUYVY(
+            i422.data[0], i422.stride[0],
+            i422.data[1], i422.stride[1],
+            i422.data[2], i422.stride[2],
+            uyvy.data[0], uyvy.stride[0],
+            width, height);
+    }
+};
+
+// vertical subsampling
+// libyuv only has I422ToNV21, which differs from NV12 only in the order of U and V.
+static constexpr Kernel i422_to_nv12 {
+    libyuv::FOURCC_I422, libyuv::FOURCC_NV12,
+    [](const Planes& i422, const Planes& nv12, int32_t width, int32_t height) {
+        libyuv::I422ToNV21(
+            i422.data[0], i422.stride[0],
+            i422.data[2], i422.stride[2],
+            i422.data[1], i422.stride[1],
+            nv12.data[0], nv12.stride[0],
+            nv12.data[1], nv12.stride[1],
+            width, height);
+    }
+};
+
+// vertical subsampling
+static constexpr Kernel i422_to_i420 {
+    libyuv::FOURCC_I422, libyuv::FOURCC_I420,
+    [](const Planes& i422, const Planes& i420, int32_t width, int32_t height) {
+        libyuv::I422ToI420(
+            i422.data[0], i422.stride[0],
+            i422.data[1], i422.stride[1],
+            i422.data[2], i422.stride[2],
+            i420.data[0], i420.stride[0],
+            i420.data[1], i420.stride[1],
+            i420.data[2], i420.stride[2],
+            width, height);
+    }
+};
 
 // horizontal upsampling and yuv conversion
-static void uyvy_to_bgra(const uint8_t *uyvy, uint8_t* bgra, int32_t width, int32_t height) {
-    libyuv::UYVYToARGB(
-        uyvy, width * 2,
-        bgra, width * 4,
-        width, height);
-}
+static constexpr Kernel i422_to_rgba {
+    libyuv::FOURCC_I422, libyuv::FOURCC_ABGR,
+    [](const Planes& i422, const Planes& rgba, int32_t width, int32_t height) {
+        libyuv::I422ToABGR(
+            i422.data[0], i422.stride[0],
+            i422.data[1], i422.stride[1],
+            i422.data[2], i422.stride[2],
+            rgba.data[0], rgba.stride[0],
+            width, height);
+    }
+};
+
+// horizontal upsampling and yuv conversion
+static constexpr Kernel uyvy_to_bgra {
+    libyuv::FOURCC_UYVY, libyuv::FOURCC_ARGB,
+    [](const Planes& uyvy, const Planes& bgra, int32_t width, int32_t height) {
+        libyuv::UYVYToARGB(
+            uyvy.data[0], uyvy.stride[0],
+            bgra.data[0], bgra.stride[0],
+            width, height);
+    }
+};
+
+// horizontal upsampling and yuv conversion (fused)
+static constexpr Kernel uyvy_to_rgba {
+    libyuv::FOURCC_UYVY, libyuv::FOURCC_ABGR,
+    [](const Planes& uyvy, const Planes& rgba, int32_t width, int32_t height) {
+        packed_via_bgra(libyuv::UYVYToARGB, libyuv::ARGBToABGR,
+                        uyvy.data[0], uyvy.stride[0], rgba.data[0], rgba.stride[0],
+                        width, height);
+    }
+};
 
 static int32_t bgra_frame_size(int32_t width, int32_t height) {
     return width * height * 4;
@@ -299,4 +863,4 @@ static int32_t i422_frame_size(int32_t width, int32_t height) {
 #define rgba_frame_size bgra_frame_size
 #define nv12_frame_size i420_frame_size
 #define uyvy_frame_size i422_frame_size
-#define yuyv_frame_size i422_frame_size
\ No newline at end of file
+#define yuyv_frame_size i422_frame_size
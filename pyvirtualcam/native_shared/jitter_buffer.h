@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "image_formats.h"
+
+// Holds frames with presentation timestamps (PTS) from a source with jittery arrival times,
+// like a network decoder, and sends them in PTS order on a thread of its own
+// at the time their PTS is due on the steady clock.
+//
+// A frame is due at pts + offset + delay, where offset is the smallest difference between
+// arrival time and PTS seen so far, that of the frame that arrived with the least delay,
+// and delay is a multiple of the arrival jitter, estimated as in RFC 3550.
+// So the buffer holds frames just long enough for most late ones to arrive in time.
+// Frames arriving after a frame with a later PTS was sent are dropped,
+// as are the earliest frames if the buffer is full.
+//
+// Frames are copied into slots allocated up front, as in AsyncSender.
+class JitterBuffer {
+  public:
+    using clock = std::chrono::steady_clock;
+    // Sends a frame, along with the time it is due on the steady clock in nanoseconds.
+    using SendFunction = std::function<void(const Planes&, int64_t)>;
+
+  private:
+    struct Entry {
+        int64_t pts_ns;
+        size_t slot;
+    };
+
+    const FormatInfo& _format;
+    int32_t _width;
+    int32_t _height;
+    size_t _depth;
+    int64_t _max_delay_ns;
+    SendFunction _send;
+    std::vector<std::vector<uint8_t>> _slots;
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::condition_variable _sent;
+    std::vector<size_t> _free_slots;
+    // Ordered by PTS.
+    std::vector<Entry> _queue;
+    bool _stopping = false;
+    std::exception_ptr _error;
+    // Arrival statistics, see above.
+    bool _arrived = false;
+    int64_t _offset_ns = 0;
+    int64_t _last_arrival_ns = 0;
+    int64_t _last_arrival_pts_ns = 0;
+    double _jitter_ns = 0;
+    int64_t _delay_ns = 0;
+    // PTS of the last frame sent, earlier frames are too late.
+    int64_t _sent_pts_ns = std::numeric_limits<int64_t>::min();
+    uint64_t _dropped = 0;
+    std::thread _thread;
+
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock::now().time_since_epoch()).count();
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _changed.wait(lock, [&] { return _stopping || !_queue.empty(); });
+            // Frames still buffered when stopping are dropped, as their time has not come.
+            if (_stopping) {
+                _sent.notify_all();
+                return;
+            }
+            Entry entry = _queue.front();
+            int64_t due_ns = entry.pts_ns + _offset_ns + _delay_ns;
+            if (now_ns() < due_ns) {
+                // Woken up early if a frame with an earlier PTS arrives meanwhile.
+                _changed.wait_until(lock, clock::time_point(
+                    std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds(due_ns))));
+                continue;
+            }
+            _queue.erase(_queue.begin());
+            _sent_pts_ns = entry.pts_ns;
+            lock.unlock();
+            try {
+                _send(frame_planes(_format.fourcc, _slots[entry.slot].data(), _width, _height), due_ns);
+            } catch (...) {
+                lock.lock();
+                _error = std::current_exception();
+                lock.unlock();
+            }
+            lock.lock();
+            _free_slots.push_back(entry.slot);
+            _sent.notify_all();
+        }
+    }
+
+    // Call with _mutex held.
+    void update_arrival(int64_t pts_ns, int64_t arrival_ns) {
+        if (!_arrived) {
+            _arrived = true;
+            _offset_ns = arrival_ns - pts_ns;
+        } else {
+            _offset_ns = std::min(_offset_ns, arrival_ns - pts_ns);
+            int64_t deviation = (arrival_ns - _last_arrival_ns) - (pts_ns - _last_arrival_pts_ns);
+            _jitter_ns += (std::abs(double(deviation)) - _jitter_ns) / 16;
+        }
+        _last_arrival_ns = arrival_ns;
+        _last_arrival_pts_ns = pts_ns;
+        _delay_ns = std::min(int64_t(3 * _jitter_ns), _max_delay_ns);
+    }
+
+  public:
+    // Holds up to `depth` frames, so that frames are delayed by at most
+    // depth - 1 frame periods at the given frame rate.
+    JitterBuffer(uint32_t fourcc, int32_t width, int32_t height, size_t depth, double fps,
+                 SendFunction send)
+        : _format(format_info(fourcc)), _width(width), _height(height),
+          _depth(depth), _max_delay_ns(int64_t((depth - 1) * 1e9 / fps)), _send(std::move(send)) {
+        if (depth < 2) {
+            throw std::invalid_argument("The jitter buffer must hold at least 2 frames.");
+        }
+        // One more slot for the frame being sent.
+        _slots.resize(depth + 1);
+        for (size_t i = 0; i < _slots.size(); i++) {
+            _slots[i].resize(frame_size(fourcc, width, height));
+            _free_slots.push_back(i);
+        }
+        _thread = std::thread(&JitterBuffer::work, this);
+    }
+
+    ~JitterBuffer() {
+        stop();
+    }
+
+    JitterBuffer(const JitterBuffer&) = delete;
+    JitterBuffer& operator=(const JitterBuffer&) = delete;
+
+    // Stops the thread, dropping buffered frames. Frames pushed afterwards are ignored.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _changed.notify_one();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    // Copies the frame into the buffer. Must not be called from several threads at once.
+    void push(const Planes& frame, int64_t pts_ns) {
+        size_t slot;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopping) {
+                return;
+            }
+            if (_error) {
+                std::exception_ptr error = _error;
+                _error = nullptr;
+                std::rethrow_exception(error);
+            }
+            update_arrival(pts_ns, now_ns());
+            if (pts_ns <= _sent_pts_ns) {
+                _dropped++;
+                return;
+            }
+            if (_queue.size() == _depth) {
+                _free_slots.push_back(_queue.front().slot);
+                _queue.erase(_queue.begin());
+                _dropped++;
+            }
+            // As in AsyncSender, at least one of the depth + 1 slots is free.
+            slot = _free_slots.back();
+            _free_slots.pop_back();
+        }
+        Planes planes = frame_planes(_format.fourcc, _slots[slot].data(), _width, _height);
+        copy_planes(_format, frame, planes, _width, _height);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto position = std::upper_bound(_queue.begin(), _queue.end(), pts_ns,
+                [](int64_t pts_ns, const Entry& entry) { return pts_ns < entry.pts_ns; });
+            _queue.insert(position, { pts_ns, slot });
+        }
+        _changed.notify_one();
+    }
+
+    // Whether all frames pushed so far have been sent or dropped.
+    bool empty() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _free_slots.size() == _slots.size();
+    }
+
+    // Waits until all frames pushed so far have been sent when they are due,
+    // or dropped as the buffer was stopped.
+    void drain() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _sent.wait(lock, [&] { return _stopping || _free_slots.size() == _slots.size(); });
+    }
+
+    // Estimated arrival jitter in nanoseconds.
+    double jitter_ns() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _jitter_ns;
+    }
+
+    // Time in nanoseconds by which frames are held beyond the earliest arrival.
+    int64_t delay_ns() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _delay_ns;
+    }
+
+    // Number of frames dropped as they arrived too late or the buffer was full.
+    uint64_t dropped() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _dropped;
+    }
+};
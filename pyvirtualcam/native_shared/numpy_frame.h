@@ -0,0 +1,156 @@
+#pragma once
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include "image_formats.h"
+
+// Planes of a frame array as passed by Camera.send() in camera.py,
+// without copying it.
+// Frames of formats with an (h, w[, c]) shape may have padded rows,
+// for example when they are a cropped view of a larger image,
+// but the pixels within a row must be contiguous.
+// Frames of other formats are 1D contiguous arrays.
+static Planes numpy_frame_planes(const pybind11::array_t<uint8_t>& frame, uint32_t fourcc,
+                                 int32_t width, int32_t height) {
+    Planes planes = frame_planes(fourcc, frame.data(), width, height);
+    if (frame.ndim() == 1) {
+        int64_t size = 0;
+        for (int i = 0; i < plane_count(fourcc); i++) {
+            size += int64_t(planes.stride[i]) * (height >> plane_vshift(fourcc, i));
+        }
+        if (frame.size() != size || frame.strides(0) != 1) {
+            throw std::invalid_argument(
+                "unexpected frame size: " + std::to_string(frame.size()) +
+                " != " + std::to_string(size) + " or frame not contiguous"
+            );
+        }
+        return planes;
+    }
+    int32_t channels = plane_row_size(fourcc, 0, width) / width;
+    bool shape_ok = plane_count(fourcc) == 1 &&
+        frame.shape(0) == height && frame.shape(1) == width &&
+        (frame.ndim() == 2 ? channels == 1 : frame.ndim() == 3 && frame.shape(2) == channels);
+    if (!shape_ok) {
+        throw std::invalid_argument("unexpected frame shape");
+    }
+    bool row_contiguous = frame.strides(1) == channels &&
+        (frame.ndim() == 2 || frame.strides(2) == 1);
+    if (!row_contiguous) {
+        throw std::invalid_argument("frame pixels must be contiguous within a row");
+    }
+    planes.stride[0] = static_cast<int32_t>(frame.strides(0));
+    return planes;
+}
+
+// Planes of a frame given as one array per plane, as passed by Camera.send() in camera.py,
+// without copying them.
+// Each array has one row per row of the plane, possibly padded,
+// and the bytes within a row must be contiguous. For example, the UV plane of NV12
+// can be of shape (h/2, w) or (h/2, w/2, 2). 1D arrays are contiguous planes.
+static Planes numpy_planes(const std::vector<pybind11::array_t<uint8_t>>& arrays, uint32_t fourcc,
+                           int32_t width, int32_t height) {
+    if (arrays.size() != size_t(plane_count(fourcc))) {
+        throw std::invalid_argument(
+            "unexpected number of planes: " + std::to_string(arrays.size()) +
+            " != " + std::to_string(plane_count(fourcc))
+        );
+    }
+    Planes planes;
+    for (int i = 0; i < plane_count(fourcc); i++) {
+        const pybind11::array_t<uint8_t>& plane = arrays[i];
+        int32_t rows = height >> plane_vshift(fourcc, i);
+        int32_t row_size = plane_row_size(fourcc, i, width);
+        planes.data[i] = const_cast<uint8_t*>(plane.data());
+        planes.stride[i] = row_size;
+        if (plane.ndim() == 1) {
+            if (plane.size() != int64_t(rows) * row_size || plane.strides(0) != 1) {
+                throw std::invalid_argument(
+                    "unexpected size of plane " + std::to_string(i) + " or plane not contiguous"
+                );
+            }
+            continue;
+        }
+        // Bytes of a row must be contiguous, checked from the last dimension backwards.
+        int64_t row_bytes = 1;
+        for (pybind11::ssize_t d = plane.ndim() - 1; d > 0; d--) {
+            if (plane.strides(d) != row_bytes) {
+                throw std::invalid_argument(
+                    "bytes within a row of plane " + std::to_string(i) + " must be contiguous"
+                );
+            }
+            row_bytes *= plane.shape(d);
+        }
+        if (plane.shape(0) != rows || row_bytes != row_size) {
+            throw std::invalid_argument("unexpected shape of plane " + std::to_string(i));
+        }
+        planes.stride[i] = static_cast<int32_t>(plane.strides(0));
+    }
+    return planes;
+}
+
+// Planes of each frame of a batch as passed by Camera.send_many() in camera.py,
+// without copying them.
+// Frames of formats with an (h, w[, c]) shape are stacked into an (n, h, w[, c]) array,
+// whose rows may be padded, as for numpy_frame_planes().
+// Frames of other formats are stacked into an (n, size) array of contiguous frames.
+// Frames may be spaced arbitrarily, for example every other frame of a larger batch.
+static std::vector<Planes> numpy_batch_planes(const pybind11::array_t<uint8_t>& frames, uint32_t fourcc,
+                                              int32_t width, int32_t height) {
+    if (frames.ndim() < 2) {
+        throw std::invalid_argument("unexpected batch shape");
+    }
+    std::vector<Planes> batch;
+    for (pybind11::ssize_t n = 0; n < frames.shape(0); n++) {
+        Planes planes = frame_planes(fourcc, frames.data() + n * frames.strides(0), width, height);
+        if (frames.ndim() == 2) {
+            int64_t size = 0;
+            for (int i = 0; i < plane_count(fourcc); i++) {
+                size += int64_t(planes.stride[i]) * (height >> plane_vshift(fourcc, i));
+            }
+            if (frames.shape(1) != size || frames.strides(1) != 1) {
+                throw std::invalid_argument(
+                    "unexpected frame size: " + std::to_string(frames.shape(1)) +
+                    " != " + std::to_string(size) + " or frames not contiguous"
+                );
+            }
+            batch.push_back(planes);
+            continue;
+        }
+        int32_t channels = plane_row_size(fourcc, 0, width) / width;
+        bool shape_ok = plane_count(fourcc) == 1 &&
+            frames.shape(1) == height && frames.shape(2) == width &&
+            (frames.ndim() == 3 ? channels == 1 : frames.ndim() == 4 && frames.shape(3) == channels);
+        if (!shape_ok) {
+            throw std::invalid_argument("unexpected frame shape");
+        }
+        bool row_contiguous = frames.strides(2) == channels &&
+            (frames.ndim() == 3 || frames.strides(3) == 1);
+        if (!row_contiguous) {
+            throw std::invalid_argument("frame pixels must be contiguous within a row");
+        }
+        planes.stride[0] = static_cast<int32_t>(frames.strides(1));
+        batch.push_back(planes);
+    }
+    return batch;
+}
+
+// A layer as passed by Camera.compose() in camera.py: its source, if it changed,
+// the fourcc and width and height of the source, and the x, y, width and height of its region.
+using NumpyLayer = std::tuple<std::optional<std::vector<pybind11::array_t<uint8_t>>>, uint32_t,
+                              int32_t, int32_t, int32_t, int32_t, int32_t, int32_t>;
+
+// Planes of a source of Camera.compose() in camera.py, without copying it:
+// either a single frame array, as for numpy_frame_planes(), or one array per plane,
+// as for numpy_planes().
+static Planes numpy_source_planes(const std::vector<pybind11::array_t<uint8_t>>& arrays, uint32_t fourcc,
+                                  int32_t width, int32_t height) {
+    if (arrays.size() == 1) {
+        return numpy_frame_planes(arrays[0], fourcc, width, height);
+    }
+    return numpy_planes(arrays, fourcc, width, height);
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "conversion_graph.h"
+#include "frame_scaler.h"
+
+// An RGBA image blended into frames after they were converted to the native format,
+// so that per frame only the pixels it covers are touched.
+//
+// The image is converted to the native format once, together with an alpha plane
+// in the layout of each plane of that format, e.g. one alpha value per byte of the UV
+// plane of NV12. Frames are then blended with libyuv::BlendPlane, which rounds
+// to within one of blending with straight alpha, unlike libyuv::ARGBBlend.
+//
+// Subsampled chroma of YUV formats is the alpha-weighted average of the pixels
+// it covers, so that the color of (partly) transparent pixels does not bleed into
+// opaque ones. It is obtained by converting the image with premultiplied alpha
+// and dividing the result by the alpha of each sample again.
+class Overlay {
+  private:
+    const FormatInfo& _format;
+    // The part of the frame the image covers, aligned to whole chroma samples
+    // and clipped to the frame, empty if the image is outside of it.
+    FrameRect _rect;
+    std::vector<uint8_t> _image;
+    Planes _image_planes;
+    std::vector<uint8_t> _alpha;
+    Planes _alpha_planes;
+
+    bool is_packed_rgba() const {
+        return _format.plane_count == 1 && _format.planes[0].bytes == 4;
+    }
+
+    // Whether a byte of a row of a plane of a YUV format is a luma sample.
+    bool is_luma(int plane, int32_t byte) const {
+        if (_format.fourcc == libyuv::FOURCC_YUY2) {
+            return byte % 2 == 0;
+        } else if (_format.fourcc == libyuv::FOURCC_UYVY) {
+            return byte % 2 == 1;
+        }
+        return plane == 0;
+    }
+
+    // Builds the alpha planes from the alpha of each pixel of the image,
+    // averaging it over the pixels that each sample covers.
+    void build_alpha(const std::vector<uint8_t>& pixel_alpha) {
+        int32_t width = _rect.width;
+        _alpha.resize(frame_size(_format.fourcc, width, _rect.height));
+        _alpha_planes = frame_planes(_format.fourcc, _alpha.data(), width, _rect.height);
+        bool packed_yuv = _format.model == ColorModel::YUV && _format.plane_count == 1;
+        for (int i = 0; i < _format.plane_count; i++) {
+            const PlaneInfo& info = _format.planes[i];
+            int32_t row_size = plane_row_size(_format, i, width);
+            int32_t rows = _rect.height >> info.vshift;
+            for (int32_t row = 0; row < rows; row++) {
+                uint8_t* out = _alpha_planes.data[i] + row * _alpha_planes.stride[i];
+                for (int32_t byte = 0; byte < row_size; byte++) {
+                    // Pixels covered by the sample, chroma of packed YUV covering a pair.
+                    int32_t x0 = (byte / info.bytes) << info.hshift;
+                    int32_t x1 = x0 + (1 << info.hshift);
+                    if (packed_yuv && !is_luma(i, byte)) {
+                        x0 &= ~1;
+                        x1 = x0 + 2;
+                    }
+                    int32_t y0 = row << info.vshift;
+                    int32_t y1 = y0 + (1 << info.vshift);
+                    int32_t sum = 0;
+                    for (int32_t y = y0; y < y1; y++) {
+                        for (int32_t x = x0; x < x1; x++) {
+                            sum += pixel_alpha[y * width + x];
+                        }
+                    }
+                    int32_t count = (x1 - x0) * (y1 - y0);
+                    out[byte] = uint8_t((sum + count / 2) / count);
+                }
+            }
+        }
+    }
+
+    // Divides YUV samples converted from premultiplied RGB by their alpha,
+    // relative to black (Y 16, U and V 128), which premultiplying moved them towards.
+    void unpremultiply() {
+        for (int i = 0; i < _format.plane_count; i++) {
+            int32_t row_size = plane_row_size(_format, i, _rect.width);
+            int32_t rows = _rect.height >> _format.planes[i].vshift;
+            for (int32_t row = 0; row < rows; row++) {
+                uint8_t* out = _image_planes.data[i] + row * _image_planes.stride[i];
+                const uint8_t* alpha = _alpha_planes.data[i] + row * _alpha_planes.stride[i];
+                for (int32_t byte = 0; byte < row_size; byte++) {
+                    if (alpha[byte] == 0) {
+                        continue;
+                    }
+                    int32_t black = is_luma(i, byte) ? 16 : 128;
+                    int32_t value = black + int32_t(std::lround((out[byte] - black) * 255.0 / alpha[byte]));
+                    out[byte] = uint8_t(std::clamp(value, 0, 255));
+                }
+            }
+        }
+    }
+
+  public:
+    // `image` is RGBA of the given size, placed with its top left corner at (x, y)
+    // of a frame in the given format and size. It may extend beyond the frame.
+    Overlay(uint32_t fourcc, int32_t frame_width, int32_t frame_height,
+            const Planes& image, int32_t width, int32_t height, int32_t x, int32_t y)
+        : _format(format_info(fourcc)), _rect { 0, 0, 0, 0 } {
+        int32_t hmask = (1 << _format.chroma_hshift) - 1;
+        int32_t vmask = (1 << _format.chroma_vshift) - 1;
+        int32_t left = std::clamp(x, 0, frame_width) & ~hmask;
+        int32_t top = std::clamp(y, 0, frame_height) & ~vmask;
+        int32_t right = std::min((std::clamp(x + width, 0, frame_width) + hmask) & ~hmask, frame_width);
+        int32_t bottom = std::min((std::clamp(y + height, 0, frame_height) + vmask) & ~vmask, frame_height);
+        if (right <= left || bottom <= top) {
+            return;
+        }
+        _rect = { left, top, right - left, bottom - top };
+
+        // The image on a transparent canvas of the aligned rectangle, in BGRA,
+        // which can be converted to more formats than RGBA.
+        std::vector<uint8_t> canvas(frame_size(libyuv::FOURCC_ARGB, _rect.width, _rect.height));
+        Planes canvas_planes = frame_planes(libyuv::FOURCC_ARGB, canvas.data(), _rect.width, _rect.height);
+        int32_t col0 = std::max(left, x);
+        int32_t col1 = std::min(right, x + width);
+        for (int32_t row = std::max(top, y); row < std::min(bottom, y + height) && col0 < col1; row++) {
+            std::memcpy(canvas_planes.data[0] + (row - top) * canvas_planes.stride[0] + (col0 - left) * 4,
+                        image.data[0] + (row - y) * image.stride[0] + (col0 - x) * 4,
+                        (col1 - col0) * 4);
+        }
+        libyuv::ARGBToABGR(canvas_planes.data[0], canvas_planes.stride[0],
+                           canvas_planes.data[0], canvas_planes.stride[0],
+                           _rect.width, _rect.height);
+        std::vector<uint8_t> pixel_alpha(size_t(_rect.width) * _rect.height);
+        for (int32_t row = 0; row < _rect.height; row++) {
+            for (int32_t col = 0; col < _rect.width; col++) {
+                pixel_alpha[row * _rect.width + col] = canvas_planes.data[0][row * canvas_planes.stride[0] + col * 4 + 3];
+            }
+        }
+        if (_format.model == ColorModel::YUV) {
+            libyuv::ARGBAttenuate(canvas_planes.data[0], canvas_planes.stride[0],
+                                  canvas_planes.data[0], canvas_planes.stride[0],
+                                  _rect.width, _rect.height);
+        }
+
+        _image.resize(frame_size(fourcc, _rect.width, _rect.height));
+        _image_planes = frame_planes(fourcc, _image.data(), _rect.width, _rect.height);
+        // The graph has no conversions to formats that no input needs to be converted to.
+        switch (fourcc) {
+            case libyuv::FOURCC_RAW:
+                libyuv::ARGBToRAW(canvas_planes.data[0], canvas_planes.stride[0],
+                                  _image_planes.data[0], _image_planes.stride[0],
+                                  _rect.width, _rect.height);
+                break;
+            case libyuv::FOURCC_24BG:
+                libyuv::ARGBToRGB24(canvas_planes.data[0], canvas_planes.stride[0],
+                                    _image_planes.data[0], _image_planes.stride[0],
+                                    _rect.width, _rect.height);
+                break;
+            case libyuv::FOURCC_J400:
+                libyuv::ARGBToJ400(canvas_planes.data[0], canvas_planes.stride[0],
+                                   _image_planes.data[0], _image_planes.stride[0],
+                                   _rect.width, _rect.height);
+                break;
+            default:
+                ConversionPlan(libyuv::FOURCC_ARGB, fourcc, _rect.width, _rect.height)(canvas_planes, _image_planes);
+        }
+
+        build_alpha(pixel_alpha);
+        if (_format.model == ColorModel::YUV) {
+            unpremultiply();
+        }
+        if (is_packed_rgba()) {
+            // Blending the alpha channel as opaque over anything leaves the frame opaque.
+            for (int32_t row = 0; row < _rect.height; row++) {
+                for (int32_t col = 0; col < _rect.width; col++) {
+                    _image_planes.data[0][row * _image_planes.stride[0] + col * 4 + 3] = 255;
+                    _alpha_planes.data[0][row * _alpha_planes.stride[0] + col * 4 + 3] = 255;
+                }
+            }
+        }
+    }
+
+    // Blends the image into a frame in the native format, in place.
+    void blend(const Planes& frame) const {
+        if (_rect.width == 0) {
+            return;
+        }
+        Planes dst = rect_planes(_format, frame, _rect);
+        for (int i = 0; i < _format.plane_count; i++) {
+            libyuv::BlendPlane(
+                _image_planes.data[i], _image_planes.stride[i],
+                dst.data[i], dst.stride[i],
+                _alpha_planes.data[i], _alpha_planes.stride[i],
+                dst.data[i], dst.stride[i],
+                plane_row_size(_format, i, _rect.width), _rect.height >> _format.planes[i].vshift);
+        }
+    }
+};
+
+// The overlay of an output, which may be replaced while frames are sent on another thread.
+// Sending holds on to the overlay it got until the frame is done.
+class OverlaySlot {
+  private:
+    std::mutex _mutex;
+    std::shared_ptr<const Overlay> _overlay;
+
+  public:
+    void set(std::shared_ptr<const Overlay> overlay) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _overlay = std::move(overlay);
+    }
+
+    std::shared_ptr<const Overlay> get() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _overlay;
+    }
+};
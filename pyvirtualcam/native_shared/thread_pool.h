@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// A persistent pool of threads that runs a batch of tasks in parallel
+// and blocks until all of them are done.
+// The calling thread works on the tasks as well, so a pool of N threads
+// starts N - 1 worker threads. A pool of one thread runs everything serially.
+class ThreadPool {
+  private:
+    std::vector<std::thread> _workers;
+    // Serializes run() calls.
+    std::mutex _run_mutex;
+    // Guards the batch state below.
+    std::mutex _mutex;
+    std::condition_variable _batch_started;
+    std::condition_variable _batch_done;
+    const std::function<void(size_t)>* _task = nullptr;
+    size_t _task_count = 0;
+    std::atomic<size_t> _next_task {0};
+    size_t _busy_workers = 0;
+    uint64_t _batch = 0;
+    bool _stopping = false;
+
+    void run_tasks() {
+        size_t i;
+        while ((i = _next_task++) < _task_count) {
+            (*_task)(i);
+        }
+    }
+
+    void work() {
+        uint64_t seen_batch = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _batch_started.wait(lock, [&] { return _stopping || _batch != seen_batch; });
+                if (_stopping) {
+                    return;
+                }
+                seen_batch = _batch;
+            }
+            run_tasks();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (--_busy_workers == 0) {
+                    _batch_done.notify_one();
+                }
+            }
+        }
+    }
+
+    static void pin_thread(std::thread& thread, uint32_t cpu) {
+#if defined(__linux__)
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+#elif defined(_WIN32)
+        SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << cpu);
+#else
+        // macOS does not support pinning threads to CPUs.
+        (void)thread;
+        (void)cpu;
+#endif
+    }
+
+  public:
+    // Worker thread i is pinned to cpu_affinity[i % cpu_affinity.size()],
+    // if cpu_affinity is not empty. The calling thread is never pinned.
+    ThreadPool(uint32_t threads, const std::vector<uint32_t>& cpu_affinity) {
+        if (threads == 0) {
+            throw std::invalid_argument("Number of threads must be at least 1.");
+        }
+        for (uint32_t i = 0; i + 1 < threads; i++) {
+            _workers.emplace_back(&ThreadPool::work, this);
+            if (!cpu_affinity.empty()) {
+                pin_thread(_workers.back(), cpu_affinity[i % cpu_affinity.size()]);
+            }
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _batch_started.notify_all();
+        for (auto& worker : _workers) {
+            worker.join();
+        }
+    }
+
+    // Number of threads working on a batch, including the calling thread.
+    size_t size() const {
+        return _workers.size() + 1;
+    }
+
+    // Calls task(i) for i in [0, task_count) and returns when all calls are done.
+    void run(size_t task_count, const std::function<void(size_t)>& task) {
+        if (_workers.empty() || task_count <= 1) {
+            for (size_t i = 0; i < task_count; i++) {
+                task(i);
+            }
+            return;
+        }
+        std::lock_guard<std::mutex> run_lock(_run_mutex);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _task = &task;
+            _task_count = task_count;
+            _next_task = 0;
+            _busy_workers = _workers.size();
+            _batch++;
+        }
+        _batch_started.notify_all();
+        run_tasks();
+        std::unique_lock<std::mutex> lock(_mutex);
+        _batch_done.wait(lock, [&] { return _busy_workers == 0; });
+        _task = nullptr;
+    }
+};
@@ -1,48 +1,46 @@
 #include <stdexcept>
 #include <optional>
+#include <tuple>
+#include <vector>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
 #include "virtual_output.h"
+#include "../native_shared/camera_base.h"
 
 namespace py = pybind11;
 
-class Camera {
-  private:
-    VirtualOutput virtual_output;
-
+class Camera : public CameraBase<VirtualOutput> {
   public:
     Camera(uint32_t width, uint32_t height, double fps, uint32_t fourcc,
-           std::optional<std::string> device_)
-     : virtual_output {width, height, fps, fourcc, device_} {
-    }
-
-    void close() {
-        virtual_output.stop();
-    }
-
-    std::string device() {
-        return virtual_output.device();
-    }
-
-    uint32_t native_fourcc() {
-        return virtual_output.native_fourcc();
-    }
-
-    void send(py::array_t<uint8_t, py::array::c_style> frame) {
-        py::buffer_info buf = frame.request();    
-        virtual_output.send(static_cast<uint8_t*>(buf.ptr));
+           std::optional<std::string> device_,
+           uint32_t threads, const std::vector<uint32_t>& cpu_affinity,
+           size_t queue_depth, const std::string& drop_policy_,
+           size_t jitter_buffer_,
+           std::optional<std::tuple<uint32_t, uint32_t>> input_size,
+           const std::string& fit, const std::string& filter,
+           bool mirror, uint32_t rotate)
+     : CameraBase(width, height, fps, fourcc, queue_depth, drop_policy_, jitter_buffer_,
+                  input_size, fit, filter, mirror, rotate,
+                  width, height, fps, fourcc, device_, threads, cpu_affinity) {
     }
 };
 
-PYBIND11_MODULE(_native_windows_obs, m) {
-    py::class_<Camera>(m, "Camera")
-        .def(py::init<uint32_t, uint32_t, double, uint32_t, std::optional<std::string>>(),
+PYBIND11_MODULE(_native_windows_obs, m, py::mod_gil_not_used()) {
+    py::class_<Camera> camera(m, "Camera");
+    camera
+        .def(py::init<uint32_t, uint32_t, double, uint32_t, std::optional<std::string>,
+                      uint32_t, const std::vector<uint32_t>&,
+                      size_t, const std::string&, size_t,
+                      std::optional<std::tuple<uint32_t, uint32_t>>, const std::string&, const std::string&,
+                      bool, uint32_t>(),
              py::kw_only(),
              py::arg("width"), py::arg("height"), py::arg("fps"),
-             py::arg("fourcc"), py::arg("device"))
-        .def("close", &Camera::close)
-        .def("send", &Camera::send)
-        .def("device", &Camera::device)
-        .def("native_fourcc", &Camera::native_fourcc);
+             py::arg("fourcc"), py::arg("device"),
+             py::arg("threads") = 1, py::arg("cpu_affinity") = std::vector<uint32_t>(),
+             py::arg("queue_depth") = 0, py::arg("drop_policy") = "drop_oldest",
+             py::arg("jitter_buffer") = 0,
+             py::arg("input_size") = py::none(), py::arg("fit") = "stretch", py::arg("filter") = "box",
+             py::arg("mirror") = false, py::arg("rotate") = 0);
+    def_camera_base(camera);
 }
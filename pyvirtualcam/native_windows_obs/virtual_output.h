@@ -1,10 +1,13 @@
 #pragma once
 
 #include <stdio.h>
+#define NOMINMAX
 #include <Windows.h>
 #include <vector>
+#include <memory>
 #include "queue/shared-memory-queue.h"
-#include "../native_shared/image_formats.h"
+#include "../native_shared/conversion_graph.h"
+#include "../native_shared/overlay.h"
 
 class VirtualOutput {
   private:
@@ -13,8 +16,10 @@ class VirtualOutput {
     uint32_t _frame_width;
     uint32_t _frame_height;
     uint32_t _frame_fourcc;
-    std::vector<uint8_t> _buffer_tmp;
     std::vector<uint8_t> _buffer_output;
+    ConversionPlan _plan;
+    OverlaySlot _overlay;
+    std::unique_ptr<ThreadPool> _pool;
     bool _have_clockfreq = false;
     LARGE_INTEGER _clock_freq;
 
@@ -34,9 +39,18 @@ class VirtualOutput {
         return static_cast<uint64_t>(time_val);
     }
 
+    // Planes of the output buffer, which is allocated on first use
+    // if the input is NV12 already.
+    Planes output_planes()
+    {
+        _buffer_output.resize(nv12_frame_size(_frame_width, _frame_height));
+        return frame_planes(libyuv::FOURCC_NV12, _buffer_output.data(), _frame_width, _frame_height);
+    }
+
   public:
     VirtualOutput(uint32_t width, uint32_t height, double fps, uint32_t fourcc,
-                  std::optional<std::string> device_) {
+                  std::optional<std::string> device_,
+                  uint32_t threads, const std::vector<uint32_t>& cpu_affinity) {
         // https://github.com/obsproject/obs-studio/blob/9da6fc67/.github/workflows/main.yml#L484
         LPCWSTR guid = L"CLSID\\{A3FCE0F5-3493-419F-958A-ABA1250EC20B}";
         HKEY key = nullptr;
@@ -56,34 +70,10 @@ class VirtualOutput {
         _frame_fourcc = libyuv::CanonicalFourCC(fourcc);
         _frame_width = width;
         _frame_height = height;
+        _pool = std::make_unique<ThreadPool>(threads, cpu_affinity);
 
-        uint32_t out_frame_size = nv12_frame_size(width, height);
-
-        switch (_frame_fourcc) {
-            case libyuv::FOURCC_RAW:
-            case libyuv::FOURCC_24BG:
-                // RGB|BGR -> I420 -> NV12
-                _buffer_tmp.resize(i420_frame_size(width, height));
-                _buffer_output.resize(out_frame_size);
-                break;
-            case libyuv::FOURCC_J400:
-                // GRAY -> BGRA -> NV12
-                _buffer_tmp.resize(bgra_frame_size(width, height));
-                _buffer_output.resize(out_frame_size);
-                break;
-            case libyuv::FOURCC_I420:
-            case libyuv::FOURCC_YUY2:
-            case libyuv::FOURCC_UYVY:
-                // I420|YUYV|UYVY -> NV12
-                _buffer_output.resize(out_frame_size);
-                break;
-            case libyuv::FOURCC_NV12:
-                break;
-            default:
-                throw std::runtime_error(
-                    "Unsupported image format."
-                );
-        }
+        // RGB|BGR|GRAY|I420|I422|YUYV|UYVY -> NV12, along the cheapest path
+        _plan = ConversionPlan(_frame_fourcc, libyuv::FOURCC_NV12, width, height);
         
         uint64_t interval = (uint64_t)(10000000.0 / fps);
 
@@ -96,6 +86,11 @@ class VirtualOutput {
         _output_running = true;
     }
 
+    ~VirtualOutput()
+    {
+        stop();
+    }
+
     void stop()
     {
         if (!_output_running) {
@@ -105,62 +100,42 @@ class VirtualOutput {
         _output_running = false;
     }
 
-    void send(const uint8_t *frame)
+    // `timestamp_ns` is the time the frame is due on the performance counter
+    // (and std::chrono::steady_clock), 0 for now.
+    void send(const Planes& frame, uint64_t timestamp_ns = 0)
     {
         if (!_output_running)
             return;
 
-        uint8_t* tmp = _buffer_tmp.data();
-        uint8_t* out_frame;
-        
-        switch (_frame_fourcc) {
-            case libyuv::FOURCC_RAW:
-                out_frame = _buffer_output.data();
-                rgb_to_i420(frame, tmp, _frame_width, _frame_height);
-                i420_to_nv12(tmp, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_24BG:
-                out_frame = _buffer_output.data();
-                bgr_to_i420(frame, tmp, _frame_width, _frame_height);
-                i420_to_nv12(tmp, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_J400:
-                out_frame = _buffer_output.data();
-                gray_to_bgra(frame, tmp, _frame_width, _frame_height);
-                bgra_to_nv12(tmp, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_I420:
-                out_frame = _buffer_output.data();
-                i420_to_nv12(frame, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_NV12:
-                out_frame = const_cast<uint8_t*>(frame);
-                break;
-            case libyuv::FOURCC_YUY2:
-                out_frame = _buffer_output.data();
-                yuyv_to_nv12(frame, out_frame, _frame_width, _frame_height);
-                break;
-            case libyuv::FOURCC_UYVY:
-                out_frame = _buffer_output.data();
-                uyvy_to_nv12(frame, out_frame, _frame_width, _frame_height);
-                break;
-            default:
-                throw std::logic_error("not implemented");
-        }
+        Planes out = frame;
+        std::shared_ptr<const Overlay> overlay = _overlay.get();
 
-        // NV12 has two planes
-        uint8_t* y = out_frame;
-        uint8_t* uv = out_frame + _frame_width * _frame_height;
+        // The queue copies each plane as a whole, so rows of NV12 input must not be padded.
+        // Frames are not blended in place, as they belong to the caller.
+        bool padded = frame.stride[0] != int32_t(_frame_width) ||
+                      frame.stride[1] != int32_t(_frame_width);
+        if (!_plan.empty() || padded || overlay) {
+            out = output_planes();
+            _plan(frame, out, _pool.get());
+        }
+        if (overlay) {
+            overlay->blend(out);
+        }
 
         // One entry per plane
         uint32_t linesize[2] = { _frame_width, _frame_width / 2 };
-        uint8_t* data[2] = { y, uv };
+        uint8_t* data[2] = { out.data[0], out.data[1] };
 
-        uint64_t timestamp = get_timestamp_ns();
+        uint64_t timestamp = timestamp_ns ? timestamp_ns : get_timestamp_ns();
 
         video_queue_write(_vq, data, linesize, timestamp);
     }
 
+    // OBS does not tell whether anybody reads, so all frames are sent.
+    bool wants_frames() {
+        return true;
+    }
+
     std::string device()
     {
         // https://github.com/obsproject/obs-studio/blob/eb98505a2/plugins/win-dshow/virtualcam-module/virtualcam-module.cpp#L196
@@ -170,4 +145,18 @@ class VirtualOutput {
     uint32_t native_fourcc() {
         return libyuv::FOURCC_NV12;
     }
+
+    const ConversionPlan& conversion_plan() {
+        return _plan;
+    }
+
+    // The threads that frames are converted on, for other work on frames before sending them.
+    ThreadPool* thread_pool() {
+        return _pool.get();
+    }
+
+    // Blends an image into each frame from now on, or no longer if nullptr.
+    void set_overlay(std::shared_ptr<const Overlay> overlay) {
+        _overlay.set(std::move(overlay));
+    }
 };
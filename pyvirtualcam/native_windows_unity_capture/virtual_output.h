@@ -4,8 +4,11 @@
 #define NOMINMAX
 #include <Windows.h>
 #include <vector>
+#include <set>
+#include <mutex>
 #include <limits>
-#include "../native_shared/image_formats.h"
+#include "../native_shared/conversion_graph.h"
+#include "../native_shared/overlay.h"
 #include "shared_memory/shared.inl"
 
 #ifdef _WIN64
@@ -44,6 +47,8 @@ static bool get_name(int num, std::string& str) {
 // or if devices are used by other tools.
 // In this case, explicitly specifying the device seems the only solution.
 static std::set<std::string> ACTIVE_DEVICES;
+// Guards ACTIVE_DEVICES, as cameras may be created and closed on different threads.
+static std::mutex ACTIVE_DEVICES_MUTEX;
 
 class VirtualOutput {
   private:
@@ -51,13 +56,21 @@ class VirtualOutput {
     uint32_t _height;
     uint32_t _fourcc;
     std::string _device;
-    std::vector<uint8_t> _tmp;
     std::vector<uint8_t> _out;
+    ConversionPlan _plan;
+    OverlaySlot _overlay;
     std::unique_ptr<SharedImageMemory> _shm;
+    // Guards _shm, as has_consumers() may be called while a sender thread is sending.
+    std::mutex _shm_mutex;
+    std::unique_ptr<ThreadPool> _pool;
     bool _running = false;
 
   public:
-    VirtualOutput(uint32_t width, uint32_t height, double fps, uint32_t fourcc, std::optional<std::string> device) {
+    VirtualOutput(uint32_t width, uint32_t height, double fps, uint32_t fourcc, std::optional<std::string> device,
+                  uint32_t threads, const std::vector<uint32_t>& cpu_affinity) {
+        // Held until the device is in ACTIVE_DEVICES,
+        // so that no other camera picks the same one meanwhile.
+        std::lock_guard<std::mutex> devices_lock(ACTIVE_DEVICES_MUTEX);
         int i;
         if (device.has_value()) {
             std::string name = *device;
@@ -95,84 +108,45 @@ class VirtualOutput {
         _height = height;
         _fourcc = libyuv::CanonicalFourCC(fourcc);
         _out.resize(rgba_frame_size(width, height));
-        switch(_fourcc) {
-            case libyuv::FOURCC_ABGR:
-            case libyuv::FOURCC_I420:
-            case libyuv::FOURCC_NV12:
-                // RGBA|I420|NV12 -> RGBA
-                // Note: RGBA -> RGBA is needed for vertical flipping.
-                break;
-            case libyuv::FOURCC_RAW:
-            case libyuv::FOURCC_24BG:
-            case libyuv::FOURCC_J400:
-            case libyuv::FOURCC_YUY2:
-            case libyuv::FOURCC_UYVY:
-                // RGB|BGR|GRAY|YUYV|UYVY -> BGRA -> RGBA
-                _tmp.resize(bgra_frame_size(width, height));
-                break;
-            default:
-                throw std::runtime_error(
-                    "Unsupported image format."
-                );
-        }
+        _pool = std::make_unique<ThreadPool>(threads, cpu_affinity);
+        _plan = ConversionPlan(_fourcc, libyuv::FOURCC_ABGR, width, height);
         ACTIVE_DEVICES.insert(_device);
         _running = true;
     }
 
+    ~VirtualOutput() {
+        stop();
+    }
+
     void stop() {
         if (!_running)
             return;
-        _shm = nullptr;
-        _running = false;
+        {
+            std::lock_guard<std::mutex> lock(_shm_mutex);
+            _shm = nullptr;
+            _running = false;
+        }
+        std::lock_guard<std::mutex> lock(ACTIVE_DEVICES_MUTEX);
         ACTIVE_DEVICES.erase(_device);
     }
 
-    void send(const uint8_t *frame) {
+    // Unity Capture has no timestamps, so `timestamp_ns` is ignored
+    // and the frame is shown when it arrives.
+    void send(const Planes& frame, int64_t timestamp_ns = 0) {
         if (!_running)
             return;
-        if (!_shm->SendIsReady()) {
+        if (!has_consumers()) {
             // happens when no app is capturing the camera yet
             return;
         }
 
-        uint8_t* tmp = _tmp.data();
-        uint8_t* out = _out.data();
+        Planes out = frame_planes(libyuv::FOURCC_ABGR, _out.data(), _width, _height);
 
         // vertical flip
-        int32_t height_invert = -static_cast<int32_t>(_height);
-
-        switch (_fourcc) {
-            case libyuv::FOURCC_RAW:
-                rgb_to_bgra(frame, tmp, _width, _height);
-                bgra_to_rgba(tmp, out, _width, height_invert);
-                break;
-            case libyuv::FOURCC_24BG:
-                bgr_to_bgra(frame, tmp, _width, _height);
-                bgra_to_rgba(tmp, out, _width, height_invert);
-                break;
-            case libyuv::FOURCC_J400:
-                gray_to_bgra(frame, tmp, _width, _height);
-                bgra_to_rgba(tmp, out, _width, height_invert);
-                break;
-            case libyuv::FOURCC_I420:
-                i420_to_rgba(frame, out, _width, height_invert);
-                break;
-            case libyuv::FOURCC_NV12:
-                nv12_to_rgba(frame, out, _width, height_invert);
-                break;
-            case libyuv::FOURCC_YUY2:
-                yuyv_to_bgra(frame, tmp, _width, _height);
-                bgra_to_rgba(tmp, out, _width, height_invert);
-                break;
-            case libyuv::FOURCC_UYVY:
-                uyvy_to_bgra(frame, tmp, _width, _height);
-                bgra_to_rgba(tmp, out, _width, height_invert);
-                break;
-            case libyuv::FOURCC_ABGR:
-                rgba_to_rgba(frame, out, _width, height_invert);
-                break;
-            default:
-                throw std::logic_error("not implemented");
+        _plan(frame, out, _pool.get(), true);
+        if (std::shared_ptr<const Overlay> overlay = _overlay.get()) {
+            // The overlay is placed from the top of the frame as sent.
+            overlay->blend(flip_planes(libyuv::FOURCC_ABGR, out, _height));
         }
         
         int stride = _width;
@@ -182,7 +156,19 @@ class VirtualOutput {
         auto mirror_mode = SharedImageMemory::MIRRORMODE_DISABLED;
         // Keep showing last received frame after stopping while receiving app is still capturing.
         constexpr int timeout = std::numeric_limits<int>::max() - SharedImageMemory::RECEIVE_MAX_WAIT;
-        _shm->Send(_width, _height, stride, _out.size(), format, resize_mode, mirror_mode, timeout, out);
+        _shm->Send(_width, _height, stride, _out.size(), format, resize_mode, mirror_mode, timeout, _out.data());
+    }
+
+    // Whether an app is capturing the camera, as the receiving filter
+    // creates the shared memory only then.
+    bool has_consumers() {
+        std::lock_guard<std::mutex> lock(_shm_mutex);
+        return _running && _shm->SendIsReady();
+    }
+
+    // Whether the next frame should be sent, which is only the case while an app is capturing.
+    bool wants_frames() {
+        return has_consumers();
     }
 
     std::string device() {
@@ -192,4 +178,18 @@ class VirtualOutput {
     uint32_t native_fourcc() {
         return libyuv::FOURCC_ABGR;
     }
+
+    const ConversionPlan& conversion_plan() {
+        return _plan;
+    }
+
+    // The threads that frames are converted on, for other work on frames before sending them.
+    ThreadPool* thread_pool() {
+        return _pool.get();
+    }
+
+    // Blends an image into each frame from now on, or no longer if nullptr.
+    void set_overlay(std::shared_ptr<const Overlay> overlay) {
+        _overlay.set(std::move(overlay));
+    }
 };
@@ -7,12 +7,12 @@ class FPSCounter(object):
         self.t_prev = None
         self.avg_delta = 1 / initial_fps
 
-    def measure(self):
+    def measure(self, frames=1):
         now = time.perf_counter()
         if self.t_prev is None:
             self.t_prev = now
         else:
-            delta = now - self.t_prev
+            delta = (now - self.t_prev) / frames
             if self.initing:
                 self.avg_delta = delta
                 self.initing = False
@@ -79,7 +79,8 @@ elif platform.system() == 'Linux':
             # (https://github.com/pybind/python_example/pull/53)
             sorted(['pyvirtualcam/native_linux_v4l2loopback/main.cpp'] + common_src),
             include_dirs=['pyvirtualcam/native_linux_v4l2loopback'] + common_inc,
-            extra_compile_args=['-flto'],
+            extra_compile_args=['-flto', '-pthread'],
+            extra_link_args=['-pthread'],
             language='c++'
         )
     )
@@ -166,7 +167,7 @@ setup(
     ],
     ext_modules=ext_modules,
     packages = find_packages(),
-    setup_requires=['pybind11>=2.6.0'],
+    setup_requires=['pybind11>=2.13'],
     install_requires=['numpy'],
     cmdclass={'build_ext': BuildExt},
     zip_safe=False,
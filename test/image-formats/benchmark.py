@@ -0,0 +1,111 @@
+# Benchmark of the conversion kernels in image_formats.h.
+# Usage: python benchmark.py [--threads N] [kernel|old+new ...]
+# A "+" joins kernels into a chain, to compare a fused kernel
+# against the multi-step conversion it replaces.
+# With --threads, each conversion is split into bands that run on N threads.
+# With --costs, the per-pixel cost of each kernel at 1080p is printed
+# in the form of KERNEL_COSTS in conversion_graph.h.
+# With --overhead, the fixed per-send overhead of the backend pipelines
+# is measured at 320x240, where it matters most.
+
+import sys
+import timeit
+import numpy as np
+from pyvirtualcam_image_formats import convert, kernels, time_send
+
+RESOLUTIONS = {
+    '720p': (1280, 720),
+    '1080p': (1920, 1080),
+    '4K': (3840, 2160),
+}
+
+# Bytes per pixel of each format, as in *_frame_size() of image_formats.h.
+BYTES_PER_PIXEL = {
+    'rgb': 3, 'bgr': 3, 'bgra': 4, 'rgba': 4, 'gray': 1,
+    'i420': 1.5, 'nv12': 1.5, 'i422': 2, 'yuyv': 2, 'uyvy': 2,
+}
+
+DEFAULT_CHAINS = [
+    'rgb_to_i420+i420_to_nv12', 'rgb_to_nv12',
+    'bgr_to_i420+i420_to_nv12', 'bgr_to_nv12',
+    'gray_to_bgra+bgra_to_nv12', 'gray_to_nv12',
+    'gray_to_bgra+bgra_to_uyvy', 'gray_to_uyvy',
+    'gray_to_bgra+bgra_to_rgba', 'gray_to_rgba',
+    'gray_to_i420',
+    'rgb_to_bgra+bgra_to_uyvy', 'rgb_to_uyvy',
+    'bgr_to_bgra+bgra_to_uyvy', 'bgr_to_uyvy',
+    'nv12_to_i420+i420_to_uyvy', 'nv12_to_uyvy',
+    'yuyv_to_i422+i422_to_uyvy', 'yuyv_to_uyvy',
+    'rgb_to_bgra+bgra_to_rgba', 'rgb_to_rgba',
+    'bgr_to_bgra+bgra_to_rgba', 'bgr_to_rgba',
+    'yuyv_to_bgra+bgra_to_rgba', 'yuyv_to_rgba',
+    'uyvy_to_bgra+bgra_to_rgba', 'uyvy_to_rgba',
+]
+
+def frame_size(fmt: str, w: int, h: int) -> int:
+    return int(w * h * BYTES_PER_PIXEL[fmt])
+
+def make_chain(chain: str, w: int, h: int, threads: int):
+    steps = []
+    fmt = chain.split('_to_')[0]
+    src = np.random.default_rng(0).integers(0, 256, frame_size(fmt, w, h), np.uint8)
+    buf = src
+    for name in chain.split('+'):
+        dst = np.empty(frame_size(name.split('_to_')[1], w, h), np.uint8)
+        steps.append((name, buf, dst))
+        buf = dst
+    def run():
+        for name, src, dst in steps:
+            convert(name, src, dst, w, h, threads)
+    return run
+
+def measure(chain: str, w: int, h: int, threads: int) -> float:
+    run = make_chain(chain, w, h, threads)
+    n, _ = timeit.Timer(run).autorange()
+    return min(timeit.repeat(run, number=n, repeat=5)) / n
+
+def print_costs(threads):
+    w, h = RESOLUTIONS['1080p']
+    for name in kernels():
+        src, dst = name.split('_to_')
+        if src == dst:
+            continue
+        t = measure(name, w, h, threads)
+        print(f'    KERNEL_COST({name}, {t * 1e9 / (w * h):.3f}),')
+
+# (input, native) format pairs of the backends.
+SEND_PIPELINES = [
+    ('rgb', 'i420'), ('bgr', 'i420'), ('i420', 'i420'), ('yuyv', 'yuyv'),  # v4l2loopback
+    ('rgb', 'nv12'), ('i420', 'nv12'), ('nv12', 'nv12'), ('yuyv', 'nv12'),  # OBS (Windows)
+    ('rgb', 'uyvy'), ('nv12', 'uyvy'), ('uyvy', 'uyvy'),  # OBS (macOS)
+    ('rgb', 'rgba'), ('rgba', 'rgba'), ('nv12', 'rgba'),  # Unity Capture
+]
+
+def print_overhead(threads):
+    w, h = 320, 240
+    for src_fmt, dst_fmt in SEND_PIPELINES:
+        src = np.random.default_rng(0).integers(0, 256, frame_size(src_fmt, w, h), np.uint8)
+        times = [time_send(src_fmt, dst_fmt, src, w, h, threads, 2000) for _ in range(5)]
+        direct = min(t[0] for t in times)
+        send = min(t[1] for t in times)
+        print(f'{src_fmt + " -> " + dst_fmt:<16} direct {direct/1000:7.2f} us'
+              f'  send {send/1000:7.2f} us  overhead {send - direct:6.0f} ns')
+
+def main(chains, threads):
+    for chain in chains:
+        for res, (w, h) in RESOLUTIONS.items():
+            t = measure(chain, w, h, threads)
+            print(f'{chain:<40} {res:>6} {t*1000:8.3f} ms')
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    threads = 1
+    if args[:1] == ['--threads']:
+        threads = int(args[1])
+        args = args[2:]
+    if args == ['--costs']:
+        print_costs(threads)
+    elif args == ['--overhead']:
+        print_overhead(threads)
+    else:
+        main(args or DEFAULT_CHAINS, threads)
@@ -0,0 +1,322 @@
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+#include "../../pyvirtualcam/native_shared/image_formats.h"
+#include "../../pyvirtualcam/native_shared/conversion_graph.h"
+#include "../../pyvirtualcam/native_shared/numpy_frame.h"
+#include "../../pyvirtualcam/native_shared/frame_scaler.h"
+#include "../../pyvirtualcam/native_shared/frame_transform.h"
+#include "../../pyvirtualcam/native_shared/overlay.h"
+#include "../../pyvirtualcam/native_shared/compositor.h"
+
+namespace py = pybind11;
+
+#define KERNEL(name) { #name, name }
+
+static const std::map<std::string, Kernel> KERNELS {
+    KERNEL(gray_to_bgra),
+    KERNEL(gray_to_rgba),
+    KERNEL(gray_to_i420),
+    KERNEL(gray_to_nv12),
+    KERNEL(gray_to_uyvy),
+    KERNEL(rgb_to_bgra),
+    KERNEL(rgb_to_rgba),
+    KERNEL(rgb_to_uyvy),
+    KERNEL(bgra_to_rgba),
+    KERNEL(bgra_to_bgra),
+    KERNEL(rgb_to_i420),
+    KERNEL(rgb_to_nv12),
+    KERNEL(bgr_to_bgra),
+    KERNEL(bgr_to_rgba),
+    KERNEL(bgr_to_uyvy),
+    KERNEL(bgr_to_i420),
+    KERNEL(bgr_to_nv12),
+    KERNEL(bgra_to_nv12),
+    KERNEL(bgra_to_uyvy),
+    KERNEL(i420_to_nv12),
+    KERNEL(i420_to_bgra),
+    KERNEL(i420_to_rgba),
+    KERNEL(i420_to_gray),
+    KERNEL(nv12_to_i420),
+    KERNEL(nv12_to_bgra),
+    KERNEL(nv12_to_rgba),
+    KERNEL(nv12_to_uyvy),
+    KERNEL(i420_to_uyvy),
+    KERNEL(yuyv_to_nv12),
+    KERNEL(yuyv_to_i420),
+    KERNEL(yuyv_to_i422),
+    KERNEL(yuyv_to_bgra),
+    KERNEL(yuyv_to_rgba),
+    KERNEL(yuyv_to_uyvy),
+    KERNEL(uyvy_to_nv12),
+    KERNEL(i422_to_uyvy),
+    KERNEL(i422_to_nv12),
+    KERNEL(i422_to_i420),
+    KERNEL(i422_to_rgba),
+    KERNEL(uyvy_to_bgra),
+    KERNEL(uyvy_to_rgba),
+};
+
+// The pool is kept across calls, like in the backends.
+static ThreadPool* thread_pool(uint32_t threads) {
+    static std::unique_ptr<ThreadPool> pool;
+    if (!pool || pool->size() != threads) {
+        pool.reset();
+        pool = std::make_unique<ThreadPool>(threads, std::vector<uint32_t>());
+    }
+    return pool.get();
+}
+
+// A negative height flips the image vertically, as in image_formats.h.
+// src is passed like frames in the backends, so it may have padded rows.
+static void convert(const std::string& name,
+                    py::array_t<uint8_t> src,
+                    py::array_t<uint8_t, py::array::c_style> dst,
+                    int32_t width, int32_t height, uint32_t threads) {
+    auto it = KERNELS.find(name);
+    if (it == KERNELS.end()) {
+        throw std::invalid_argument("Unknown kernel: " + name);
+    }
+    const Kernel& kernel = it->second;
+    int32_t abs_height = std::abs(height);
+    py::buffer_info dst_buf = dst.request(true);
+    kernel(numpy_frame_planes(src, kernel.src_fourcc, width, abs_height),
+           frame_planes(kernel.dst_fourcc, static_cast<uint8_t*>(dst_buf.ptr), width, abs_height),
+           width, height, thread_pool(threads));
+}
+
+// Like convert(), with src given as one array per plane.
+static void convert_planes(const std::string& name,
+                           std::vector<py::array_t<uint8_t>> src,
+                           py::array_t<uint8_t, py::array::c_style> dst,
+                           int32_t width, int32_t height, uint32_t threads) {
+    auto it = KERNELS.find(name);
+    if (it == KERNELS.end()) {
+        throw std::invalid_argument("Unknown kernel: " + name);
+    }
+    const Kernel& kernel = it->second;
+    int32_t abs_height = std::abs(height);
+    py::buffer_info dst_buf = dst.request(true);
+    kernel(numpy_planes(src, kernel.src_fourcc, width, abs_height),
+           frame_planes(kernel.dst_fourcc, static_cast<uint8_t*>(dst_buf.ptr), width, abs_height),
+           width, height, thread_pool(threads));
+}
+
+static uint32_t format_fourcc(const std::string& name) {
+    for (const FormatInfo& format : FORMATS) {
+        if (name == format.name) {
+            return format.fourcc;
+        }
+    }
+    throw std::invalid_argument("Unknown format: " + name);
+}
+
+// Kernel names along the cheapest path between two formats, and its cost in ns per pixel.
+static std::pair<std::vector<std::string>, double> plan(const std::string& src_format,
+                                                        const std::string& dst_format,
+                                                        int32_t width, int32_t height) {
+    ConversionPlan plan(format_fourcc(src_format), format_fourcc(dst_format), width, height);
+    return { plan.path(), plan.cost() };
+}
+
+// Like convert(), along the cheapest path between two formats.
+static void convert_planned(const std::string& src_format, const std::string& dst_format,
+                            py::array_t<uint8_t> src,
+                            py::array_t<uint8_t, py::array::c_style> dst,
+                            int32_t width, int32_t height, uint32_t threads) {
+    uint32_t src_fourcc = format_fourcc(src_format);
+    uint32_t dst_fourcc = format_fourcc(dst_format);
+    int32_t abs_height = std::abs(height);
+    ConversionPlan plan(src_fourcc, dst_fourcc, width, abs_height);
+    py::buffer_info dst_buf = dst.request(true);
+    plan(numpy_frame_planes(src, src_fourcc, width, abs_height),
+         frame_planes(dst_fourcc, static_cast<uint8_t*>(dst_buf.ptr), width, abs_height),
+         thread_pool(threads), height < 0);
+}
+
+// Scales a frame of the input size into dst of the given size, as done for the input_size
+// of a camera, with the fit and filter names of the backend arguments.
+static void scale(const std::string& format,
+                  py::array_t<uint8_t> src,
+                  py::array_t<uint8_t, py::array::c_style> dst,
+                  int32_t input_width, int32_t input_height,
+                  int32_t width, int32_t height,
+                  const std::string& fit, const std::string& filter) {
+    uint32_t fourcc = format_fourcc(format);
+    FrameScaler scaler(fourcc, input_width, input_height, width, height, parse_fit(fit), parse_filter(filter));
+    py::buffer_info dst_buf = dst.request(true);
+    copy_planes(fourcc, scaler(numpy_frame_planes(src, fourcc, input_width, input_height)),
+                frame_planes(fourcc, static_cast<uint8_t*>(dst_buf.ptr), width, height),
+                width, height);
+}
+
+// Mirrors and rotates a frame of the given size into dst, as done for the mirror
+// and rotate arguments of a camera. dst is height x width for 90 and 270 degrees.
+static void transform(const std::string& format,
+                      py::array_t<uint8_t> src,
+                      py::array_t<uint8_t, py::array::c_style> dst,
+                      int32_t width, int32_t height, bool mirror, uint32_t rotate) {
+    uint32_t fourcc = format_fourcc(format);
+    FrameTransform frame_transform(fourcc, width, height, mirror, rotate);
+    auto [out_width, out_height] = unrotated_size(width, height, rotate);
+    py::buffer_info dst_buf = dst.request(true);
+    copy_planes(fourcc, frame_transform(numpy_frame_planes(src, fourcc, width, height)),
+                frame_planes(fourcc, static_cast<uint8_t*>(dst_buf.ptr), out_width, out_height),
+                out_width, out_height);
+}
+
+// Blends an RGBA image of shape (h, w, 4) into a frame of the given size in place,
+// with its top left corner at (x, y), as done by Camera.set_overlay().
+static void blend(const std::string& format,
+                  py::array_t<uint8_t, py::array::c_style> frame,
+                  int32_t width, int32_t height,
+                  py::array_t<uint8_t> image, int32_t x, int32_t y) {
+    uint32_t fourcc = format_fourcc(format);
+    if (image.ndim() != 3) {
+        throw std::invalid_argument("unexpected overlay shape, expected (h, w, 4)");
+    }
+    int32_t image_width = int32_t(image.shape(1));
+    int32_t image_height = int32_t(image.shape(0));
+    Overlay overlay(fourcc, width, height,
+                    numpy_frame_planes(image, libyuv::FOURCC_ABGR, image_width, image_height),
+                    image_width, image_height, x, y);
+    py::buffer_info frame_buf = frame.request(true);
+    overlay.blend(frame_planes(fourcc, static_cast<uint8_t*>(frame_buf.ptr), width, height));
+}
+
+// A Compositor and the format and size of its frames, which are copied out after each call.
+struct TestCompositor {
+    uint32_t fourcc;
+    int32_t width;
+    int32_t height;
+    Compositor compositor;
+
+    TestCompositor(const std::string& format, int32_t width, int32_t height)
+        : fourcc(format_fourcc(format)), width(width), height(height),
+          compositor(fourcc, width, height) {}
+};
+
+// The format name of a layer, its source frame if it changed, the width and height
+// of the source, and the x, y, width and height of its region.
+using TestLayer = std::tuple<std::string, std::optional<py::array_t<uint8_t>>,
+                             int32_t, int32_t, int32_t, int32_t, int32_t, int32_t>;
+
+// Composes a frame as done by Camera.compose() and copies it into dst.
+static void compose(TestCompositor& self, const std::vector<TestLayer>& layers,
+                    py::array_t<uint8_t, py::array::c_style> dst, uint32_t threads) {
+    std::vector<CompositorLayer> specs;
+    std::vector<std::optional<Planes>> sources;
+    for (const auto& [format, source, width, height, x, y, rect_width, rect_height] : layers) {
+        uint32_t fourcc = format_fourcc(format);
+        specs.push_back({ fourcc, width, height, { x, y, rect_width, rect_height } });
+        sources.push_back(source ? std::optional<Planes>(numpy_frame_planes(*source, fourcc, width, height))
+                                 : std::nullopt);
+    }
+    const Planes& frame = self.compositor.compose(specs, sources, thread_pool(threads));
+    py::buffer_info dst_buf = dst.request(true);
+    copy_planes(self.fourcc, frame,
+                frame_planes(self.fourcc, static_cast<uint8_t*>(dst_buf.ptr), self.width, self.height),
+                self.width, self.height);
+}
+
+template <typename F>
+static double time_per_call(F f, int iterations) {
+    for (int i = 0; i < iterations / 10 + 1; i++) {
+        f();
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        f();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+// Time in ns per frame of sending a frame through a backend pipeline, as in Camera::send()
+// of the backends, and of calling the conversion function of a single-step plan directly.
+// The difference is the fixed per-send overhead, which matters for small frames.
+// Timing happens here to exclude the overhead of calling from Python.
+static std::pair<double, double> time_send(const std::string& src_format, const std::string& dst_format,
+                                           py::array_t<uint8_t> src,
+                                           int32_t width, int32_t height,
+                                           uint32_t threads, int iterations) {
+    uint32_t src_fourcc = format_fourcc(src_format);
+    uint32_t dst_fourcc = format_fourcc(dst_format);
+    ConversionPlan plan(src_fourcc, dst_fourcc, width, height);
+    std::vector<uint8_t> dst(frame_size(dst_fourcc, width, height));
+    Planes dst_planes = frame_planes(dst_fourcc, dst.data(), width, height);
+    ThreadPool* pool = thread_pool(threads);
+
+    double send = time_per_call([&] {
+        plan(numpy_frame_planes(src, src_fourcc, width, height), dst_planes, pool);
+    }, iterations);
+
+    std::vector<std::string> path = plan.path();
+    if (path.size() > 1) {
+        throw std::invalid_argument("Only plans with at most one step can be compared.");
+    }
+    const Kernel* kernel = nullptr;
+    for (const KernelCost& edge : KERNEL_COSTS) {
+        if (!path.empty() && path[0] == edge.name) {
+            kernel = edge.kernel;
+        }
+    }
+    Planes src_planes = numpy_frame_planes(src, src_fourcc, width, height);
+    double direct = time_per_call([&] {
+        if (kernel) {
+            kernel->convert(src_planes, dst_planes, width, height);
+        } else {
+            copy_planes(src_fourcc, src_planes, dst_planes, width, height);
+        }
+    }, iterations);
+    return { direct, send };
+}
+
+static std::vector<std::string> kernels() {
+    std::vector<std::string> names;
+    for (auto& kernel : KERNELS) {
+        names.push_back(kernel.first);
+    }
+    return names;
+}
+
+PYBIND11_MODULE(_image_formats, m) {
+    m.def("convert", &convert,
+          py::arg("name"), py::arg("src"), py::arg("dst"),
+          py::arg("width"), py::arg("height"), py::arg("threads") = 1);
+    m.def("convert_planes", &convert_planes,
+          py::arg("name"), py::arg("src"), py::arg("dst"),
+          py::arg("width"), py::arg("height"), py::arg("threads") = 1);
+    m.def("plan", &plan,
+          py::arg("src_format"), py::arg("dst_format"),
+          py::arg("width"), py::arg("height"));
+    m.def("convert_planned", &convert_planned,
+          py::arg("src_format"), py::arg("dst_format"), py::arg("src"), py::arg("dst"),
+          py::arg("width"), py::arg("height"), py::arg("threads") = 1);
+    m.def("time_send", &time_send,
+          py::arg("src_format"), py::arg("dst_format"), py::arg("src"),
+          py::arg("width"), py::arg("height"), py::arg("threads") = 1, py::arg("iterations") = 1000);
+    m.def("scale", &scale,
+          py::arg("format"), py::arg("src"), py::arg("dst"),
+          py::arg("input_width"), py::arg("input_height"), py::arg("width"), py::arg("height"),
+          py::arg("fit") = "stretch", py::arg("filter") = "box");
+    m.def("transform", &transform,
+          py::arg("format"), py::arg("src"), py::arg("dst"),
+          py::arg("width"), py::arg("height"), py::arg("mirror") = false, py::arg("rotate") = 0);
+    m.def("blend", &blend,
+          py::arg("format"), py::arg("frame"), py::arg("width"), py::arg("height"),
+          py::arg("image"), py::arg("x") = 0, py::arg("y") = 0);
+    py::class_<TestCompositor>(m, "Compositor")
+        .def(py::init<const std::string&, int32_t, int32_t>(),
+             py::arg("format"), py::arg("width"), py::arg("height"))
+        .def("compose", &compose, py::arg("layers"), py::arg("dst"), py::arg("threads") = 1);
+    m.def("kernels", &kernels);
+}
@@ -0,0 +1,4 @@
+from pyvirtualcam_image_formats._image_formats import (
+    convert, convert_planes, convert_planned, plan, time_send, kernels,
+    scale, transform, blend, Compositor,
+)
@@ -1,6 +1,8 @@
 from typing import Any, Dict, Tuple
 import os
 import platform
+import threading
+import time
 import pytest
 import numpy as np
 import pyvirtualcam
@@ -125,6 +127,10 @@ def test_alternative_pixel_formats(backend: str):
         check_native_fmt(cam)
         cam.send(np.zeros(cam.height * cam.width + cam.height * (cam.width // 2), np.uint8))
     
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=PixelFormat.I422, backend=backend) as cam:
+        check_native_fmt(cam)
+        cam.send(np.zeros(cam.height * cam.width * 2, np.uint8))
+
     with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=PixelFormat.YUYV, backend=backend) as cam:
         check_native_fmt(cam)
         cam.send(np.zeros(cam.height * cam.width * 2, np.uint8))
@@ -133,6 +139,451 @@ def test_alternative_pixel_formats(backend: str):
         check_native_fmt(cam)
         cam.send(np.zeros(cam.height * cam.width * 2, np.uint8))
 
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_send_frame_view(backend: str):
+    image = np.zeros((800, 1400, 4), np.uint8)
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=PixelFormat.RGB, backend=backend) as cam:
+        cam.send(image[10:730, 20:1300, :3]) # not contiguous within rows, copied
+        cam.send(image[10:730, 20:1300, :3].copy()[:, ::-1]) # reversed row, copied
+        cam.send(np.ascontiguousarray(image[:, :, :3])[10:730, 20:1300]) # padded rows
+        cam.send(np.ascontiguousarray(image[:, :, :3])[730:10:-1, 20:1300]) # flipped view
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=PixelFormat.GRAY, backend=backend) as cam:
+        cam.send(image[10:730, 20:1300, 0]) # not contiguous within rows, copied
+        cam.send(np.ascontiguousarray(image[:, :, 0])[10:730, 20:1300]) # padded rows
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_send_planes(backend: str):
+    w, h = 1280, 720
+    with pyvirtualcam.Camera(width=w, height=h, fps=20, fmt=PixelFormat.I420, backend=backend) as cam:
+        cam.send((np.zeros((h, w), np.uint8), np.zeros((h // 2, w // 2), np.uint8), np.zeros((h // 2, w // 2), np.uint8)))
+        cam.send([np.zeros(h * w, np.uint8), np.zeros(h * w // 4, np.uint8), np.zeros(h * w // 4, np.uint8)])
+        with pytest.raises(ValueError):
+            cam.send((np.zeros((h, w), np.uint8), np.zeros((h // 2, w // 2), np.uint8)))
+    with pyvirtualcam.Camera(width=w, height=h, fps=20, fmt=PixelFormat.NV12, backend=backend) as cam:
+        padded = np.zeros((h, w + 64), np.uint8)
+        cam.send((padded[:, :w], np.zeros((h // 2, w // 2, 2), np.uint8)))
+    with pyvirtualcam.Camera(width=w, height=h, fps=20, fmt=PixelFormat.I422, backend=backend) as cam:
+        cam.send((np.zeros((h, w), np.uint8), np.zeros((h, w // 2), np.uint8), np.zeros((h, w // 2), np.uint8)))
+    with pyvirtualcam.Camera(width=w, height=h, fps=20, fmt=PixelFormat.RGB, backend=backend) as cam:
+        with pytest.raises(ValueError):
+            cam.send((np.zeros((h, w, 3), np.uint8),))
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_conversion_threads(backend: str):
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=PixelFormat.BGR, backend=backend,
+                             threads=4, cpu_affinity=[0]) as cam:
+        cam.send(np.zeros((cam.height, cam.width, 3), np.uint8))
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_conversion_path(backend: str):
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=PixelFormat.RGB, backend=backend) as cam:
+        assert cam.conversion_path and all(isinstance(step, str) for step in cam.conversion_path)
+        assert cam.conversion_path[0].startswith('rgb_to_')
+        assert cam.conversion_cost > 0
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=cam.native_fmt, backend=backend) as cam:
+        assert cam.conversion_path == []
+        assert cam.conversion_cost == 0
+
+@pytest.mark.parametrize("drop_policy", ['drop_oldest', 'drop_newest', 'block'])
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_queued_send(backend: str, drop_policy: str):
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=PixelFormat.BGR, backend=backend,
+                             queue_depth=2, drop_policy=drop_policy) as cam:
+        frame = np.zeros((cam.height, cam.width, 3), np.uint8)
+        for i in range(20):
+            frame[:] = i
+            cam.send(frame)
+            assert cam.queued_frames <= 2
+        if drop_policy == 'block':
+            assert cam.dropped_frames == 0
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.Camera(width=1280, height=720, fps=20, backend=backend, drop_policy='newest')
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_invalid_arguments_leave_device_free(backend: str):
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, backend=backend) as cam:
+        device = cam.device
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.Camera(width=1280, height=720, fps=0, backend=backend, device=device)
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.Camera(width=1280, height=720, fps=20, backend=backend, device=device,
+                            queue_depth=2, jitter_buffer=8)
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, backend=backend, device=device):
+        pass
+
+@pytest.mark.skipif(
+    'v4l2loopback' not in pyvirtualcam.camera.BACKENDS,
+    reason='consumer events are specific to v4l2loopback')
+def test_has_consumers():
+    with pyvirtualcam.Camera(width=640, height=480, fps=30, backend='v4l2loopback') as cam:
+        frame = np.zeros((cam.height, cam.width, 3), np.uint8)
+        for _ in range(3):
+            cam.send(frame)
+        # Nothing reads from the device during tests.
+        # None if the installed v4l2loopback is too old to tell.
+        assert cam.has_consumers in (False, None)
+        assert cam.frames_sent == 3
+
+@pytest.mark.skipif(
+    'v4l2loopback' not in pyvirtualcam.camera.BACKENDS,
+    reason='loopback controls are specific to v4l2loopback')
+def test_hold_frame():
+    width, height = 640, 480
+    timeout_image = np.full((height, width, 3), 128, np.uint8)
+    with pyvirtualcam.Camera(width=width, height=height, fps=30, backend='v4l2loopback',
+                             sustain_framerate=True, timeout=500, timeout_image=timeout_image) as cam:
+        frame = np.zeros((cam.height, cam.width, 3), np.uint8)
+        assert cam.hold_frame(frame)
+        assert cam.frames_sent == 1
+        # Releases the held frame.
+        cam.send(frame)
+        assert cam.hold_frame()
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.Camera(width=width, height=height, fps=30, backend='v4l2loopback',
+                            timeout_image=timeout_image[:, :, :2])
+
+def loopback_timeout(device: str) -> int:
+    import fcntl
+    import struct
+    VIDIOC_G_CTRL = 0xc008561b
+    V4L2LOOPBACK_CID_TIMEOUT = (0x00980900 | 0xf000) + 2  # V4L2_CID_USER_BASE | 0xf000, see virtual_output.h
+    with open(device, 'rb') as f:
+        control = fcntl.ioctl(f, VIDIOC_G_CTRL, struct.pack('Ii', V4L2LOOPBACK_CID_TIMEOUT, 0))
+    return struct.unpack('Ii', control)[1]
+
+@pytest.mark.skipif(
+    'v4l2loopback' not in pyvirtualcam.camera.BACKENDS,
+    reason='loopback controls are specific to v4l2loopback')
+@pytest.mark.parametrize("queue", ['queue_depth', 'jitter_buffer'])
+def test_hold_frame_after_queued_frames(queue: str):
+    with pyvirtualcam.Camera(width=640, height=480, fps=30, backend='v4l2loopback',
+                             timeout=500, **{queue: 4}) as cam:
+        frame = np.zeros((cam.height, cam.width, 3), np.uint8)
+        for i in range(4):
+            if queue == 'jitter_buffer':
+                cam.send(frame, pts=i / 30)
+            else:
+                cam.send(frame)
+        # Frames queued before are sent first and do not release the hold.
+        assert cam.hold_frame()
+        assert cam.queued_frames == 0
+        time.sleep(0.2)
+        assert loopback_timeout(cam.device) == 0
+        cam.send(frame)
+        time.sleep(0.2)
+        assert loopback_timeout(cam.device) == 500
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_send_from_threads(backend: str):
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=PixelFormat.BGR, backend=backend) as cam:
+        frame = np.zeros((cam.height, cam.width, 3), np.uint8)
+        def send():
+            for _ in range(20):
+                cam.send(frame)
+        threads = [threading.Thread(target=send) for _ in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        assert cam.frames_sent == 80
+
+def aggregate_fps(backend: str, camera_count: int, seconds: float = 2) -> float:
+    cameras = [pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=PixelFormat.BGR, backend=backend)
+               for _ in range(camera_count)]
+    try:
+        frame = np.zeros((720, 1280, 3), np.uint8)
+        def send(cam):
+            end = time.perf_counter() + seconds
+            while time.perf_counter() < end:
+                cam.send(frame)
+        threads = [threading.Thread(target=send, args=(cam,)) for cam in cameras]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        return sum(cam.frames_sent for cam in cameras) / seconds
+    finally:
+        for cam in cameras:
+            cam.close()
+
+@pytest.mark.skipif(
+    platform.system() == 'Darwin',
+    reason='multiple cameras not supported on macOS (obs backend)')
+@pytest.mark.skipif((os.cpu_count() or 1) < 4, reason='needs at least 4 CPUs')
+@pytest.mark.parametrize("backend", 
+    ['unitycapture'] if platform.system() == 'Windows' else ['v4l2loopback'])
+def test_send_scales_with_threads(backend: str):
+    # Requires at least 4 devices.
+    single = aggregate_fps(backend, 1)
+    parallel = aggregate_fps(backend, 4)
+    print(f'{single:.0f} fps with one camera, {parallel:.0f} fps with four cameras on four threads')
+    assert parallel > 2.5 * single
+
+@pytest.mark.skipif(
+    'v4l2loopback' not in pyvirtualcam.camera.BACKENDS,
+    reason='only v4l2loopback lists its devices')
+def test_list_devices():
+    devices = pyvirtualcam.list_devices('v4l2loopback')
+    assert devices and all(d.device.startswith('/dev/video') and d.backend == 'v4l2loopback'
+                           for d in devices)
+    assert pyvirtualcam.list_devices() == devices
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=PixelFormat.I420,
+                             backend='v4l2loopback') as cam:
+        cam.send(np.zeros(cam.width * cam.height * 3 // 2, np.uint8))
+        device, = [d for d in pyvirtualcam.list_devices('v4l2loopback') if d.device == cam.device]
+        assert (device.fmt, device.width, device.height) == (PixelFormat.I420, 1280, 720)
+
+@pytest.mark.skipif(
+    'v4l2loopback' not in pyvirtualcam.camera.BACKENDS,
+    reason='native pacing is specific to v4l2loopback')
+def test_native_pacing():
+    target_fps = 60
+    with pyvirtualcam.Camera(width=640, height=480, fps=target_fps, backend='v4l2loopback') as cam:
+        assert cam.pacing_jitter == (0, 0)
+        frame = np.zeros((cam.height, cam.width, 3), np.uint8)
+        cam.send(frame)
+        cam.sleep_until_next_frame()
+        start = time.perf_counter()
+        for _ in range(120):
+            cam.send(frame)
+            cam.sleep_until_next_frame()
+        # No drift: 120 frames take 2 seconds, however late single wake-ups are.
+        assert abs(time.perf_counter() - start - 2) < 0.05
+        mean, max_ = cam.pacing_jitter
+        assert 0 <= mean <= max_ < 1000 / target_fps
+
+def test_native_pacing_over_budget():
+    target_fps = 60
+    with pyvirtualcam.Camera(width=640, height=480, fps=target_fps, backend='v4l2loopback') as cam:
+        frame = np.zeros((cam.height, cam.width, 3), np.uint8)
+        cam.sleep_until_next_frame()
+        start = time.perf_counter()
+        for _ in range(60):
+            cam.send(frame)
+            # Slightly longer than a frame.
+            time.sleep(1.1 / target_fps)
+            cam.sleep_until_next_frame()
+        # Returns right away when late instead of waiting for the next slot,
+        # which would halve the frame rate.
+        assert time.perf_counter() - start < 1.5
+        mean, max_ = cam.pacing_jitter
+        assert 0 < mean <= max_
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_send_many(backend: str):
+    fps = 30
+    with pyvirtualcam.Camera(width=640, height=480, fps=fps, fmt=PixelFormat.BGR, backend=backend) as cam:
+        frames = np.zeros((30, cam.height, cam.width, 3), np.uint8)
+        start = time.perf_counter()
+        first_sent, dropped = cam.send_many(frames)
+        assert first_sent + dropped == 30 and first_sent > 0
+        # Paced at fps, the last frame is sent 29 frames after the first.
+        assert time.perf_counter() - start >= 29 / fps
+        # Every other frame of a batch, sent as fast as possible.
+        assert cam.send_many(frames[::2], pace=False) == (15, 0)
+        timestamps = np.arange(10) * 0.01 + 100
+        start = time.perf_counter()
+        sent, dropped = cam.send_many(frames[:10], timestamps)
+        assert sent + dropped == 10
+        assert time.perf_counter() - start >= 0.09
+        assert cam.frames_sent == first_sent + 15 + sent
+        with pytest.raises(ValueError):
+            cam.send_many(frames[:10], timestamps[:5])
+        with pytest.raises(ValueError):
+            cam.send_many(frames[:, :, :-1])
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_jitter_buffer(backend: str):
+    fps = 50
+    with pyvirtualcam.Camera(width=640, height=480, fps=fps, fmt=PixelFormat.BGR, backend=backend,
+                             jitter_buffer=8) as cam:
+        frame = np.zeros((cam.height, cam.width, 3), np.uint8)
+        rng = np.random.default_rng(0)
+        start = time.perf_counter()
+        # Frames 20 ms apart arrive up to 10 ms late, some out of order.
+        for i in range(50):
+            time.sleep(max(0, start + i / fps + rng.uniform(0, 0.01) - time.perf_counter()))
+            cam.send(frame, pts=1000 + i / fps)
+        assert 0 < cam.arrival_jitter < 20
+        assert 0 <= cam.playout_delay <= 7 * 1000 / fps
+        assert cam.dropped_frames < 5
+        with pytest.raises(ValueError):
+            cam.send(frame[:, :-1], pts=2000)
+    with pyvirtualcam.Camera(width=640, height=480, fps=fps, fmt=PixelFormat.BGR, backend=backend) as cam:
+        assert cam.arrival_jitter is None and cam.playout_delay is None
+        with pytest.raises(ValueError):
+            cam.send(np.zeros((cam.height, cam.width, 3), np.uint8), pts=0)
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.Camera(width=640, height=480, fps=fps, backend=backend, jitter_buffer=8, queue_depth=2)
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+@pytest.mark.parametrize("fit", ['stretch', 'letterbox', 'crop'])
+def test_input_size(backend: str, fit: str):
+    with pyvirtualcam.Camera(width=640, height=360, fps=20, fmt=PixelFormat.I420, backend=backend,
+                             input_size=(1280, 960), fit=fit) as cam:
+        assert cam.input_size == (1280, 960)
+        frame = np.zeros(1280 * 960 * 3 // 2, np.uint8)
+        cam.send(frame)
+        cam.send((frame[:1280 * 960].reshape(960, 1280),
+                  frame[1280 * 960:1280 * 960 * 5 // 4], frame[1280 * 960 * 5 // 4:]))
+        cam.send_many(np.stack([frame, frame]), pace=False)
+        with pytest.raises(ValueError):
+            cam.send(np.zeros(640 * 360 * 3 // 2, np.uint8))
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.Camera(width=640, height=360, fps=20, backend=backend,
+                            input_size=(1280, 960), fit='zoom')
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.Camera(width=640, height=360, fps=20, fmt=PixelFormat.YUYV, backend=backend,
+                            input_size=(1280, 960))
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+@pytest.mark.parametrize("mirror,rotate", [(True, 0), (False, 90), (True, 180), (False, 270)])
+def test_mirror_rotate(backend: str, mirror: bool, rotate: int):
+    with pyvirtualcam.Camera(width=640, height=480, fps=20, fmt=PixelFormat.BGR, backend=backend,
+                             mirror=mirror, rotate=rotate) as cam:
+        expected = (480, 640) if rotate in (90, 270) else (640, 480)
+        assert cam.input_size == expected
+        frame = np.zeros((expected[1], expected[0], 3), np.uint8)
+        cam.send(frame)
+        cam.send_many(np.stack([frame, frame]), pace=False)
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.Camera(width=640, height=480, fps=20, backend=backend, rotate=45)
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_overlay(backend: str):
+    with pyvirtualcam.Camera(width=640, height=480, fps=20, backend=backend) as cam:
+        logo = np.zeros((64, 128, 4), np.uint8)
+        logo[..., 0] = 255
+        logo[..., 3] = np.linspace(0, 255, 128, dtype=np.uint8)
+        cam.set_overlay(logo, 16, 16)
+        cam.send(np.zeros((cam.height, cam.width, 3), np.uint8))
+        # Partly outside of the frame, and a view with padded rows.
+        cam.set_overlay(np.zeros((480, 640, 4), np.uint8)[100:200, 100:300], 590, -30)
+        cam.send(np.zeros((cam.height, cam.width, 3), np.uint8))
+        cam.set_overlay(None)
+        cam.send(np.zeros((cam.height, cam.width, 3), np.uint8))
+        with pytest.raises(ValueError):
+            cam.set_overlay(np.zeros((64, 128, 3), np.uint8))
+
+@pytest.mark.parametrize("backend", list(pyvirtualcam.camera.BACKENDS))
+def test_compose(backend: str):
+    w, h = 640, 480
+    with pyvirtualcam.Camera(width=w, height=h, fps=20, fmt=PixelFormat.I420, backend=backend) as cam:
+        screen = np.zeros((720, 1280, 3), np.uint8)
+        webcam = (np.zeros((240, 320), np.uint8), np.zeros((120, 320), np.uint8))
+        layers = [
+            (screen, PixelFormat.RGB, (0, 0, w, h)),
+            (webcam, PixelFormat.NV12, (w - 176, h - 136, 160, 120)),
+        ]
+        cam.compose(layers)
+        # The webcam is kept as it is.
+        cam.compose([layers[0], (None, PixelFormat.NV12, layers[1][2])])
+        assert cam.frames_sent == 2
+        with pytest.raises(ValueError):
+            cam.compose([(screen, PixelFormat.RGB, (1, 0, w - 1, h))])
+        with pytest.raises(ValueError):
+            cam.compose([(np.zeros(320 * 240 * 3 // 2, np.uint8), PixelFormat.I420, (0, 0, w, h))])
+
+def test_custom_backend():
+    sent = []
+    class CustomBackend(pyvirtualcam.Backend):
+        def __init__(self, **kw):
+            pass
+        def close(self):
+            pass
+        def send(self, frame):
+            sent.append(frame)
+        def device(self):
+            return 'custom'
+        def native_fourcc(self):
+            return None
+    pyvirtualcam.register_backend('custom', CustomBackend)
+    try:
+        w, h = 64, 48
+        with pyvirtualcam.Camera(width=w, height=h, fps=20, fmt=PixelFormat.NV12, backend='custom') as cam:
+            assert cam.conversion_path is None
+            assert cam.conversion_cost is None
+            assert cam.queued_frames is None and cam.dropped_frames is None
+            assert cam.pacing_jitter is None
+            assert cam.has_consumers is None
+            assert not cam.hold_frame()
+            cam.send((np.zeros((h, w), np.uint8), np.ones((h // 2, w), np.uint8)))
+            assert cam.send_many(np.zeros((3, w * h * 3 // 2), np.uint8), pace=False) == (3, 0)
+            assert cam.frames_sent == 4
+        assert len(sent) == 4 and sent[0].shape == (w * h * 3 // 2,)
+        assert sent[0][w * h:].all() and not sent[0][:w * h].any()
+    finally:
+        del pyvirtualcam.camera.BACKENDS['custom']
+
+@pytest.mark.skipif(
+    'v4l2loopback' not in pyvirtualcam.camera.BACKENDS,
+    reason='streaming options are specific to v4l2loopback')
+@pytest.mark.parametrize("buffers", [0, 1, 2, 4])
+def test_v4l2loopback_streaming(buffers: int):
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, backend='v4l2loopback',
+                             buffers=buffers) as cam:
+        frame = np.zeros((cam.height, cam.width, 3), np.uint8)
+        for i in range(10):
+            frame[:] = i
+            cam.send(frame)
+
+@pytest.mark.skipif(
+    'v4l2loopback' not in pyvirtualcam.camera.BACKENDS,
+    reason='passthrough is specific to v4l2loopback')
+@pytest.mark.parametrize("fmt", [PixelFormat.RGB, PixelFormat.BGR])
+def test_v4l2loopback_passthrough(fmt: PixelFormat):
+    with pyvirtualcam.Camera(width=1280, height=720, fps=20, fmt=fmt, backend='v4l2loopback',
+                             passthrough=True) as cam:
+        assert cam.native_fmt in (fmt, PixelFormat.I420)
+        if cam.native_fmt == fmt:
+            assert cam.conversion_path == []
+        cam.send(np.zeros((cam.height, cam.width, 3), np.uint8))
+
+@pytest.mark.skipif(
+    'v4l2loopback' not in pyvirtualcam.camera.MULTI_BACKENDS,
+    reason='multiple outputs are specific to v4l2loopback')
+def test_multi_camera():
+    outputs = [(1280, 720, PixelFormat.NV12), (640, 360, PixelFormat.GRAY)]
+    with pyvirtualcam.MultiCamera(1280, 720, 20, outputs, backend='v4l2loopback', threads=2) as cam:
+        assert len(set(cam.devices)) == 2
+        assert cam.device == cam.devices[0]
+        assert [output.fmt for output in cam.outputs] == [PixelFormat.NV12, PixelFormat.GRAY]
+        assert cam.native_fmt == PixelFormat.I420
+        assert cam.conversion_path == ['rgb_to_i420']
+        frame = np.zeros((cam.height, cam.width, 3), np.uint8)
+        for i in range(10):
+            frame[:] = i
+            cam.send(frame)
+        assert cam.frames_sent == 10
+    # There is no conversion from I420 to YUYV.
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.MultiCamera(1280, 720, 20, [(640, 360, PixelFormat.YUYV)], backend='v4l2loopback')
+
+@pytest.mark.skipif(
+    'v4l2loopback' not in pyvirtualcam.camera.MOSAIC_BACKENDS,
+    reason='mosaics are specific to v4l2loopback')
+def test_mosaic_camera():
+    w, h = 320, 240
+    tiles = [(col * w, row * h, w, h) for row in range(2) for col in range(2)]
+    tiles[3] += (PixelFormat.NV12,)
+    with pyvirtualcam.MosaicCamera(2 * w, 2 * h, 20, tiles, fmt=PixelFormat.I420,
+                                   backend='v4l2loopback', threads=2) as cam:
+        assert len(set(cam.devices)) == 4
+        assert cam.device == cam.devices[0]
+        assert [tile.fmt for tile in cam.tiles] == [PixelFormat.I420] * 3 + [PixelFormat.NV12]
+        frame = np.zeros(cam.width * cam.height * 3 // 2, np.uint8)
+        for i in range(10):
+            frame[:] = i
+            cam.send(frame)
+        assert cam.frames_sent == 10
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.MosaicCamera(2 * w, 2 * h, 20, [(1, 0, w, h)], fmt=PixelFormat.I420,
+                                  backend='v4l2loopback')
+
+def test_invalid_conversion_threads():
+    with pytest.raises(RuntimeError):
+        pyvirtualcam.Camera(width=1280, height=720, fps=20, threads=0)
+
 @pytest.mark.skipif(
     os.environ.get('CI') and platform.system() == 'Darwin',
     reason='disabled due to high fluctuations in CI, manually verified on MacBook Pro')
@@ -0,0 +1,387 @@
+from typing import List
+import pytest
+import numpy as np
+
+# Requires the test helper package in test/image-formats.
+image_formats = pytest.importorskip('pyvirtualcam_image_formats')
+
+sizes = [(64, 48), (1280, 720), (1920, 1080)]
+
+# Bytes per pixel of each format, as in *_frame_size() of image_formats.h.
+BYTES_PER_PIXEL = {
+    'rgb': 3, 'bgr': 3, 'bgra': 4, 'rgba': 4, 'gray': 1,
+    'i420': 1.5, 'nv12': 1.5, 'i422': 2, 'yuyv': 2, 'uyvy': 2,
+}
+
+# Single-pass kernels and the multi-step conversions they must match exactly.
+FUSED_KERNELS = {
+    'rgb_to_nv12': ['rgb_to_i420', 'i420_to_nv12'],
+    'bgr_to_nv12': ['bgr_to_i420', 'i420_to_nv12'],
+    'gray_to_nv12': ['gray_to_bgra', 'bgra_to_nv12'],
+    'gray_to_i420': ['gray_to_nv12', 'nv12_to_i420'],
+    'gray_to_uyvy': ['gray_to_bgra', 'bgra_to_uyvy'],
+    'gray_to_rgba': ['gray_to_bgra', 'bgra_to_rgba'],
+    'rgb_to_uyvy': ['rgb_to_bgra', 'bgra_to_uyvy'],
+    'bgr_to_uyvy': ['bgr_to_bgra', 'bgra_to_uyvy'],
+    'nv12_to_uyvy': ['nv12_to_i420', 'i420_to_uyvy'],
+    'yuyv_to_uyvy': ['yuyv_to_i422', 'i422_to_uyvy'],
+    'rgb_to_rgba': ['rgb_to_bgra', 'bgra_to_rgba'],
+    'bgr_to_rgba': ['bgr_to_bgra', 'bgra_to_rgba'],
+    'yuyv_to_rgba': ['yuyv_to_bgra', 'bgra_to_rgba'],
+    'uyvy_to_rgba': ['uyvy_to_bgra', 'bgra_to_rgba'],
+    'i422_to_nv12': ['i422_to_i420', 'i420_to_nv12'],
+    'i422_to_rgba': ['i422_to_uyvy', 'uyvy_to_bgra', 'bgra_to_rgba'],
+}
+
+def frame_size(fmt: str, w: int, h: int) -> int:
+    return int(w * h * BYTES_PER_PIXEL[fmt])
+
+def random_frame(size: int) -> np.ndarray:
+    rng = np.random.default_rng(42)
+    return rng.integers(0, 256, size, np.uint8)
+
+def convert(name: str, src: np.ndarray, width: int, height: int, threads: int = 1) -> np.ndarray:
+    dst = np.zeros(frame_size(name.split('_to_')[1], width, abs(height)), np.uint8)
+    image_formats.convert(name, src, dst, width, height, threads)
+    return dst
+
+def convert_chain(names: List[str], src: np.ndarray, width: int, height: int) -> np.ndarray:
+    # Only the first step flips, if requested.
+    for i, name in enumerate(names):
+        src = convert(name, src, width, height if i == 0 else abs(height))
+    return src
+
+@pytest.mark.parametrize("size", sizes)
+@pytest.mark.parametrize("flip", [False, True])
+@pytest.mark.parametrize("kernel", list(FUSED_KERNELS))
+def test_fused_kernel_matches_multi_step(kernel: str, flip: bool, size):
+    w, h = size
+    h_ = -h if flip else h
+    frame = random_frame(frame_size(kernel.split('_to_')[0], w, h))
+    expected = convert_chain(FUSED_KERNELS[kernel], frame, w, h_)
+    actual = convert(kernel, frame, w, h_)
+    np.testing.assert_array_equal(actual, expected)
+
+@pytest.mark.parametrize("size", sizes)
+def test_gray_to_i420_range(size):
+    w, h = size
+    frame = random_frame(w * h)
+    i420 = convert('gray_to_i420', frame, w, h)
+    # full range -> limited range
+    assert i420[:w * h].min() >= 16 and i420[:w * h].max() <= 235
+    assert (i420[w * h:] == 128).all()
+
+@pytest.mark.parametrize("size", sizes)
+def test_i420_to_gray_round_trip(size):
+    w, h = size
+    frame = random_frame(w * h)
+    gray = convert('i420_to_gray', convert('gray_to_i420', frame, w, h), w, h)
+    # limited range -> full range, off by at most one from rounding twice
+    assert np.abs(gray.astype(int) - frame).max() <= 1
+
+# Heights that do not split evenly into bands, including an odd number of chroma rows.
+@pytest.mark.parametrize("size", sizes + [(640, 482)])
+@pytest.mark.parametrize("flip", [False, True])
+@pytest.mark.parametrize("threads", [2, 3, 8])
+@pytest.mark.parametrize("kernel", image_formats.kernels())
+def test_parallel_matches_serial(kernel: str, threads: int, flip: bool, size):
+    w, h = size
+    h_ = -h if flip else h
+    frame = random_frame(frame_size(kernel.split('_to_')[0], w, h))
+    expected = convert(kernel, frame, w, h_)
+    actual = convert(kernel, frame, w, h_, threads)
+    np.testing.assert_array_equal(actual, expected)
+
+# Formats that can be passed as (h, w[, c]) arrays with padded rows.
+PACKED_CHANNELS = {'rgb': 3, 'bgr': 3, 'bgra': 4, 'rgba': 4, 'gray': 1}
+
+@pytest.mark.parametrize("view", ['crop', 'flip'])
+@pytest.mark.parametrize("kernel", [k for k in image_formats.kernels()
+                                    if k.split('_to_')[0] in PACKED_CHANNELS])
+def test_padded_rows_match_contiguous(kernel: str, view: str):
+    w, h = 640, 480
+    c = PACKED_CHANNELS[kernel.split('_to_')[0]]
+    image = random_frame((h + 20) * (w + 40) * c).reshape(h + 20, w + 40, c)
+    frame = image[7:7 + h, 13:13 + w]
+    if view == 'flip':
+        frame = frame[::-1]
+    if c == 1:
+        frame = frame[:, :, 0]
+    assert not frame.flags.c_contiguous
+    expected = convert(kernel, np.ascontiguousarray(frame).reshape(-1), w, h)
+    actual = convert(kernel, frame, w, h, threads=2)
+    np.testing.assert_array_equal(actual, expected)
+
+# (rows, bytes per row) of each plane, as in PlaneShapes of camera.py.
+PLANE_SHAPES = {
+    'i420': lambda w, h: [(h, w), (h // 2, w // 2), (h // 2, w // 2)],
+    'nv12': lambda w, h: [(h, w), (h // 2, w)],
+    'i422': lambda w, h: [(h, w), (h, w // 2), (h, w // 2)],
+}
+
+def split_planes(frame: np.ndarray, fmt: str, w: int, h: int, layout: str) -> List[np.ndarray]:
+    planes = []
+    offset = 0
+    for rows, row_size in PLANE_SHAPES[fmt](w, h):
+        plane = frame[offset:offset + rows * row_size].reshape(rows, row_size)
+        offset += rows * row_size
+        if layout == 'padded':
+            padded = np.zeros((rows + 3, row_size + 24), np.uint8)
+            padded[1:1 + rows, 8:8 + row_size] = plane
+            plane = padded[1:1 + rows, 8:8 + row_size]
+        elif layout == '1d':
+            plane = plane.copy().reshape(-1)
+        planes.append(plane)
+    return planes
+
+@pytest.mark.parametrize("layout", ['views', 'padded', '1d'])
+@pytest.mark.parametrize("flip", [False, True])
+@pytest.mark.parametrize("kernel", [k for k in image_formats.kernels()
+                                    if k.split('_to_')[0] in PLANE_SHAPES])
+def test_planes_match_frame(kernel: str, flip: bool, layout: str):
+    w, h = 640, 480
+    h_ = -h if flip else h
+    fmt = kernel.split('_to_')[0]
+    frame = random_frame(frame_size(fmt, w, h))
+    planes = split_planes(frame, fmt, w, h, layout)
+    expected = convert(kernel, frame, w, h_)
+    actual = np.zeros_like(expected)
+    image_formats.convert_planes(kernel, planes, actual, w, h_, 2)
+    np.testing.assert_array_equal(actual, expected)
+
+FORMATS = list(BYTES_PER_PIXEL)
+
+# Paths the planner must choose. rgb -> uyvy is cheaper through i420,
+# but that would drop half of the vertical chroma resolution.
+EXPECTED_PATHS = {
+    ('rgb', 'uyvy'): ['rgb_to_uyvy'],
+    ('rgb', 'nv12'): ['rgb_to_nv12'],
+    ('nv12', 'uyvy'): ['nv12_to_uyvy'],
+    ('i422', 'bgra'): ['i422_to_uyvy', 'uyvy_to_bgra'],
+    ('uyvy', 'i420'): ['uyvy_to_nv12', 'nv12_to_i420'],
+    ('nv12', 'nv12'): [],
+    ('i420', 'gray'): ['i420_to_gray'],
+}
+
+@pytest.mark.parametrize("formats", list(EXPECTED_PATHS))
+def test_plan_path(formats):
+    path, cost = image_formats.plan(*formats, 64, 48)
+    assert path == EXPECTED_PATHS[formats]
+    assert (cost > 0) == bool(path)
+
+def plannable(src: str, dst: str) -> bool:
+    try:
+        image_formats.plan(src, dst, 64, 48)
+    except RuntimeError:
+        return False
+    return True
+
+def test_plan_unsupported():
+    assert not plannable('rgba', 'nv12')
+    assert not plannable('rgb', 'gray')
+
+def flip_frame(frame: np.ndarray, fmt: str, w: int, h: int) -> np.ndarray:
+    if fmt in PLANE_SHAPES:
+        planes = split_planes(frame, fmt, w, h, 'views')
+        return np.concatenate([plane[::-1].reshape(-1) for plane in planes])
+    return frame.reshape(h, -1)[::-1].reshape(-1)
+
+@pytest.mark.parametrize("threads", [1, 3])
+@pytest.mark.parametrize("flip", [False, True])
+@pytest.mark.parametrize("formats", [(src, dst) for src in FORMATS for dst in FORMATS
+                                     if plannable(src, dst)])
+def test_planned_matches_path(formats, flip: bool, threads: int):
+    src, dst = formats
+    w, h = 640, 482
+    h_ = -h if flip else h
+    frame = random_frame(frame_size(src, w, h))
+    path, _ = image_formats.plan(src, dst, w, h)
+    if path:
+        expected = convert_chain(path, frame, w, h_)
+    else:
+        expected = flip_frame(frame, src, w, h) if flip else frame
+    actual = np.zeros(frame_size(dst, w, h), np.uint8)
+    image_formats.convert_planned(src, dst, frame, actual, w, h_, threads)
+    np.testing.assert_array_equal(actual, expected)
+
+def test_time_send():
+    w, h = 320, 240
+    frame = random_frame(frame_size('rgb', w, h))
+    direct, send = image_formats.time_send('rgb', 'i420', frame, w, h, iterations=10)
+    assert direct > 0 and send > 0
+    with pytest.raises(ValueError):
+        image_formats.time_send('i422', 'bgra', random_frame(frame_size('i422', w, h)), w, h, iterations=10)
+
+# Subsampling (horizontal, vertical) and bytes per sample of each plane, as in FORMATS of image_formats.h.
+PLANE_SAMPLING = {
+    'rgb': [(1, 1, 3)], 'bgr': [(1, 1, 3)], 'bgra': [(1, 1, 4)], 'rgba': [(1, 1, 4)], 'gray': [(1, 1, 1)],
+    'i420': [(1, 1, 1), (2, 2, 1), (2, 2, 1)], 'nv12': [(1, 1, 1), (2, 2, 2)], 'i422': [(1, 1, 1), (2, 1, 1), (2, 1, 1)],
+}
+
+def pixel_planes(frame: np.ndarray, fmt: str, w: int, h: int) -> List[np.ndarray]:
+    """Views of the planes of a contiguous frame of shape (rows, columns, bytes per sample)."""
+    planes = []
+    offset = 0
+    for hs, vs, b in PLANE_SAMPLING[fmt]:
+        rows, cols = h // vs, w // hs
+        planes.append(frame[offset:offset + rows * cols * b].reshape(rows, cols, b))
+        offset += rows * cols * b
+    return planes
+
+def rect_planes(frame: np.ndarray, fmt: str, w: int, h: int, rect) -> List[np.ndarray]:
+    x, y, rw, rh = rect
+    return [plane[y // vs:(y + rh) // vs, x // hs:(x + rw) // hs]
+            for plane, (hs, vs, _) in zip(pixel_planes(frame, fmt, w, h), PLANE_SAMPLING[fmt])]
+
+def black_frame(fmt: str, w: int, h: int) -> np.ndarray:
+    frame = np.zeros(frame_size(fmt, w, h), np.uint8)
+    planes = pixel_planes(frame, fmt, w, h)
+    if fmt in ('bgra', 'rgba'):
+        planes[0][..., 3] = 255
+    elif fmt in PLANE_SHAPES:
+        planes[0][:] = 16
+        for plane in planes[1:]:
+            plane[:] = 128
+    return frame
+
+SCALE_FORMATS = ['rgb', 'bgra', 'gray', 'i420', 'nv12', 'i422']
+
+# Input size, camera size, fit, and the part of the input used and where it ends up.
+# The sizes of both parts are the same, so that the scaling itself is a copy.
+FIT_CASES = [
+    ((640, 360), (640, 480), 'letterbox', (0, 0, 640, 360), (0, 60, 640, 360)),
+    ((360, 480), (640, 480), 'letterbox', (0, 0, 360, 480), (140, 0, 360, 480)),
+    ((640, 480), (640, 360), 'crop', (0, 60, 640, 360), (0, 0, 640, 360)),
+    ((480, 360), (360, 360), 'crop', (60, 0, 360, 360), (0, 0, 360, 360)),
+]
+
+@pytest.mark.parametrize("fmt", SCALE_FORMATS)
+@pytest.mark.parametrize("case", FIT_CASES)
+def test_scale_fit_rects(case, fmt: str):
+    (iw, ih), (w, h), fit, src_rect, dst_rect = case
+    frame = random_frame(frame_size(fmt, iw, ih))
+    expected = black_frame(fmt, w, h)
+    for dst, src in zip(rect_planes(expected, fmt, w, h, dst_rect), rect_planes(frame, fmt, iw, ih, src_rect)):
+        dst[:] = src
+    actual = np.zeros(frame_size(fmt, w, h), np.uint8)
+    image_formats.scale(fmt, frame, actual, iw, ih, w, h, fit, 'point')
+    np.testing.assert_array_equal(actual, expected)
+
+@pytest.mark.parametrize("fmt", ['rgb', 'gray', 'i420'])
+def test_scale_box_halves(fmt: str):
+    w, h = 640, 480
+    frame = random_frame(frame_size(fmt, w, h))
+    actual = np.zeros(frame_size(fmt, w // 2, h // 2), np.uint8)
+    image_formats.scale(fmt, frame, actual, w, h, w // 2, h // 2, 'stretch', 'box')
+    for src, dst in zip(pixel_planes(frame, fmt, w, h), pixel_planes(actual, fmt, w // 2, h // 2)):
+        rows, cols, b = src.shape
+        expected = src.reshape(rows // 2, 2, cols // 2, 2, b).astype(int).sum(axis=(1, 3)) / 4
+        assert np.abs(dst - expected).max() <= 1
+
+# Formats that can be rotated, with NV12 rotating each UV pair as one sample.
+TRANSFORM_FORMATS = ['rgb', 'bgr', 'bgra', 'rgba', 'gray', 'i420', 'nv12', 'i422']
+
+@pytest.mark.parametrize("fmt", TRANSFORM_FORMATS)
+@pytest.mark.parametrize("rotate", [0, 90, 180, 270])
+@pytest.mark.parametrize("mirror", [False, True])
+def test_transform_matches_numpy(mirror: bool, rotate: int, fmt: str):
+    if fmt == 'i422' and rotate in (90, 270):
+        pytest.skip('rotating I422 by 90 degrees makes it I440, which has no plane layout here')
+    if not mirror and rotate == 0:
+        pytest.skip('no transform')
+    w, h = 640, 480
+    frame = random_frame(frame_size(fmt, w, h))
+    ow, oh = (h, w) if rotate in (90, 270) else (w, h)
+    actual = np.zeros(frame_size(fmt, ow, oh), np.uint8)
+    image_formats.transform(fmt, frame, actual, w, h, mirror, rotate)
+    for src, dst in zip(pixel_planes(frame, fmt, w, h), pixel_planes(actual, fmt, ow, oh)):
+        expected = np.fliplr(src) if mirror else src
+        # np.rot90 turns counterclockwise.
+        expected = np.rot90(expected, -rotate // 90)
+        np.testing.assert_array_equal(dst, expected)
+
+def straight_blend(frame: np.ndarray, image: np.ndarray, channels: List[int]) -> np.ndarray:
+    """Blends the channels of an RGBA image, in the order of the frame, with straight alpha."""
+    alpha = image[..., 3:].astype(float) / 255
+    blended = frame.astype(float)
+    blended[..., :3] = image[..., channels] * alpha + frame[..., :3] * (1 - alpha)
+    return blended
+
+# Channels of an RGBA image in the byte order of each format with RGB channels.
+RGB_CHANNELS = {'rgb': [0, 1, 2], 'bgr': [2, 1, 0], 'rgba': [0, 1, 2], 'bgra': [2, 1, 0]}
+
+@pytest.mark.parametrize("fmt", list(RGB_CHANNELS))
+@pytest.mark.parametrize("position", [(100, 50), (-30, -20), (600, 440)])
+def test_overlay_straight_alpha(position, fmt: str):
+    w, h = 640, 480
+    x, y = position
+    frame = random_frame(frame_size(fmt, w, h))
+    if fmt in ('bgra', 'rgba'):
+        frame.reshape(h, w, 4)[..., 3] = 255
+    image = np.random.default_rng(7).integers(0, 256, (64, 96, 4), np.uint8)
+    # Opaque and transparent pixels, too.
+    image[:8, :, 3] = 255
+    image[8:16, :, 3] = 0
+    expected = frame.reshape(h, w, -1).astype(float)
+    x0, y0 = max(x, 0), max(y, 0)
+    x1, y1 = min(x + 96, w), min(y + 64, h)
+    expected[y0:y1, x0:x1] = straight_blend(frame.reshape(h, w, -1)[y0:y1, x0:x1],
+                                            image[y0 - y:y1 - y, x0 - x:x1 - x], RGB_CHANNELS[fmt])
+    actual = frame.copy()
+    image_formats.blend(fmt, actual, w, h, image, x, y)
+    assert np.abs(actual.reshape(h, w, -1) - expected).max() <= 1
+
+def compose(compositor, fmt: str, w: int, h: int, layers, threads: int = 1) -> np.ndarray:
+    frame = np.zeros(frame_size(fmt, w, h), np.uint8)
+    compositor.compose(layers, frame, threads)
+    return frame
+
+def layer(fmt: str, source, rect):
+    x, y, rw, rh = rect
+    return (fmt, source, rw, rh, x, y, rw, rh)
+
+def paste(frame: np.ndarray, fmt: str, w: int, h: int, source: np.ndarray, rect) -> None:
+    x, y, rw, rh = rect
+    for dst, src in zip(rect_planes(frame, fmt, w, h, rect), pixel_planes(source, fmt, rw, rh)):
+        dst[:] = src
+
+@pytest.mark.parametrize("threads", [1, 3])
+@pytest.mark.parametrize("fmt", ['rgb', 'i420', 'nv12'])
+def test_compositor_redraws_cached_layer(fmt: str, threads: int):
+    w, h = 640, 480
+    # A picture-in-picture layer over the background, and one beside it.
+    rects = [(0, 0, 640, 480), (400, 280, 200, 160), (40, 40, 100, 80)]
+    rng = np.random.default_rng(3)
+    def source(rect):
+        return rng.integers(0, 256, frame_size(fmt, rect[2], rect[3]), np.uint8)
+    sources = [source(rect) for rect in rects]
+    compositor = image_formats.Compositor(fmt, w, h)
+
+    def expected_frame():
+        frame = black_frame(fmt, w, h)
+        for src, rect in zip(sources, rects):
+            paste(frame, fmt, w, h, src, rect)
+        return frame
+
+    actual = compose(compositor, fmt, w, h, [layer(fmt, s, r) for s, r in zip(sources, rects)], threads)
+    np.testing.assert_array_equal(actual, expected_frame())
+
+    # Only the background changes: the cached layer over it is copied over it again.
+    sources[0] = source(rects[0])
+    actual = compose(compositor, fmt, w, h,
+                     [layer(fmt, sources[0], rects[0]), layer(fmt, None, rects[1]), layer(fmt, None, rects[2])],
+                     threads)
+    np.testing.assert_array_equal(actual, expected_frame())
+
+    # Only a layer on top changes.
+    sources[1] = source(rects[1])
+    actual = compose(compositor, fmt, w, h,
+                     [layer(fmt, None, rects[0]), layer(fmt, sources[1], rects[1]), layer(fmt, None, rects[2])],
+                     threads)
+    np.testing.assert_array_equal(actual, expected_frame())
+
+def test_compositor_needs_sources_for_new_layout():
+    compositor = image_formats.Compositor('rgb', 64, 48)
+    frame = np.zeros(frame_size('rgb', 64, 48), np.uint8)
+    with pytest.raises(ValueError):
+        compositor.compose([layer('rgb', None, (0, 0, 64, 48))], frame)